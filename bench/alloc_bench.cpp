@@ -0,0 +1,449 @@
+// allocation counting and memory footprint report
+
+/**
+ * Replaces the global operator new/delete to count the allocations and
+ *  bytes done by every construction path of shared_ptr and unique_ptr,
+ *  checks them against the expected counts, and prints sizeof for the
+ *  smart pointers and their control blocks with different deleter kinds.
+ *
+ * Counts include the allocation of the object itself where the path
+ *  takes a raw pointer, so shared_ptr(new T) is expected to allocate
+ *  twice (object + control block) and make_shared once.
+ *
+ * Also checks that a slot_map whose emplace threw gives no value for
+ *  the default handle, that poly_value aligns over-aligned types, and
+ *  that the aligned factories reject an alignment that is not a power
+ *  of two.
+ *
+ * Exits with a non-zero status when a count, a size or a check regresses,
+ *  so "make check" fails.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#include "../smart_ptr.hpp"
+
+using smart_ptr::unique_ptr;
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::default_delete;
+using smart_ptr::make_shared;
+using smart_ptr::make_unique;
+using smart_ptr::make_shared_for_overwrite;
+using smart_ptr::make_unique_for_overwrite;
+using smart_ptr::make_shared_aligned;
+using smart_ptr::make_unique_aligned;
+using smart_ptr::poly_value;
+using smart_ptr::make_poly_value;
+using smart_ptr::shared_bytes;
+using smart_ptr::bytes_pool;
+
+// Global allocation counters
+
+namespace
+{
+
+    struct alloc_stats
+    {
+        long allocs;
+        long frees;
+        std::size_t bytes;
+    };
+
+    alloc_stats g_stats = { 0, 0, 0 };
+
+    void *
+    counted_alloc(std::size_t n)
+    {
+        ++g_stats.allocs;
+        g_stats.bytes += n;
+        if (void *p = std::malloc(n ? n : 1))
+            return p;
+        throw std::bad_alloc{};
+    }
+
+    void
+    counted_free(void *p) noexcept
+    {
+        if (p)
+        {
+            ++g_stats.frees;
+            std::free(p);
+        }
+    }
+
+} // namespace
+
+void *operator new(std::size_t n) { return counted_alloc(n); }
+void *operator new[](std::size_t n) { return counted_alloc(n); }
+void *operator new(std::size_t n, const std::nothrow_t &) noexcept
+{
+    try { return counted_alloc(n); } catch (...) { return nullptr; }
+}
+void *operator new[](std::size_t n, const std::nothrow_t &) noexcept
+{
+    try { return counted_alloc(n); } catch (...) { return nullptr; }
+}
+void operator delete(void *p) noexcept { counted_free(p); }
+void operator delete[](void *p) noexcept { counted_free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { counted_free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { counted_free(p); }
+#if defined(__cpp_sized_deallocation)
+void operator delete(void *p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void *p, std::size_t) noexcept { counted_free(p); }
+#endif
+
+namespace
+{
+
+    struct widget
+    {
+        long a;
+        long b;
+    };
+
+    struct shape
+    {
+        virtual ~shape() = default;
+    };
+
+    struct small_shape : shape
+    {
+        long w;
+        long h;
+    };
+
+    struct large_shape : shape
+    {
+        long points[16];
+    };
+
+    struct alignas(64) aligned64_shape : shape
+    {
+        long v;
+    };
+
+    struct construction_failure
+    {
+    };
+
+    struct alignas(128) aligned128_shape : shape
+    {
+        explicit aligned128_shape(bool fail = false)
+        {
+            if (fail)
+                throw construction_failure{}; // allocates nothing through operator new
+        }
+
+        long v;
+    };
+
+    int g_failures = 0;
+
+    /// Runs f and checks that it performs exactly `expected` allocations
+    /// and frees everything it allocated
+    template<typename F>
+    void
+    check_allocs(const char *path, long expected, F f)
+    {
+        alloc_stats before = g_stats;
+        f();
+        long allocs = g_stats.allocs - before.allocs;
+        long frees = g_stats.frees - before.frees;
+        std::size_t bytes = g_stats.bytes - before.bytes;
+        bool ok = allocs == expected && frees == allocs;
+        if (!ok)
+            ++g_failures;
+        std::printf("  %-4s %-44s allocs %ld (expected %ld), frees %ld, bytes %zu\n",
+            ok ? "ok" : "FAIL", path, allocs, expected, frees, bytes);
+    }
+
+    /// Prints sizeof(T) and checks it against an upper bound when one is given
+    void
+    check_size(const char *type, std::size_t size, std::size_t bound = 0)
+    {
+        bool ok = !bound || size <= bound;
+        if (!ok)
+            ++g_failures;
+        if (bound)
+            std::printf("  %-4s %-44s %3zu bytes (at most %zu)\n", ok ? "ok" : "FAIL", type, size, bound);
+        else
+            std::printf("       %-44s %3zu bytes\n", type, size);
+    }
+
+    /// Checks a property that is neither a count nor a size
+    void
+    check(const char *what, bool ok)
+    {
+        if (!ok)
+            ++g_failures;
+        std::printf("  %-4s %s\n", ok ? "ok" : "FAIL", what);
+    }
+
+    struct throwing_widget
+    {
+        explicit throwing_widget(bool fail)
+        {
+            if (fail)
+                throw std::runtime_error{ "throwing_widget" };
+        }
+    };
+
+    bool
+    is_aligned(const void *p, std::size_t align)
+    {
+        return reinterpret_cast<std::uintptr_t>(p) % align == 0;
+    }
+
+    void
+    free_int(int *p)
+    {
+        delete p;
+    }
+
+} // namespace
+
+int main()
+{
+    auto stateless = [](int *p) { delete p; };
+    long state = 0;
+    auto stateful = [state](int *p) { (void)state; delete p; };
+    using stateless_t = decltype(stateless);
+    using stateful_t = decltype(stateful);
+
+    std::printf("shared_ptr construction paths\n");
+    check_allocs("shared_ptr()", 0, [] { shared_ptr<widget> sp; });
+    check_allocs("shared_ptr(nullptr)", 0, [] { shared_ptr<widget> sp{ nullptr }; });
+    check_allocs("shared_ptr(new T)", 2, [] { shared_ptr<widget> sp{ new widget{} }; });
+    check_allocs("shared_ptr(new T, fnptr)", 2, [] { shared_ptr<int> sp{ new int{}, &free_int }; });
+    check_allocs("shared_ptr(new T, lambda)", 2, [&] { shared_ptr<int> sp{ new int{}, stateless }; });
+    check_allocs("shared_ptr(nullptr, deleter)", 1, [] { shared_ptr<int> sp{ nullptr, default_delete<int>{} }; });
+    check_allocs("shared_ptr(unique_ptr<T>{ new T })", 2, [] {
+        shared_ptr<widget> sp{ unique_ptr<widget>{ new widget{} } };
+    });
+    check_allocs("make_shared<T>()", 1, [] { auto sp = make_shared<widget>(); });
+    check_allocs("make_shared<T>(args...)", 1, [] { auto sp = make_shared<widget>(1L, 2L); });
+    check_allocs("make_shared<T[]>(n)", 1, [] { auto sp = make_shared<widget[]>(16); });
+    check_allocs("make_shared<T[]>(n, init)", 1, [] { auto sp = make_shared<widget[]>(16, widget{ 1, 2 }); });
+    check_allocs("make_shared<T[N]>()", 1, [] { auto sp = make_shared<widget[16]>(); });
+    check_allocs("make_shared_aligned<T[]>(n, 64)", 1, [] { auto sp = make_shared_aligned<float[]>(64, 64); });
+    {
+        bool rejected = false;
+        try
+        {
+            auto sp = make_shared_aligned<float[]>(64, 48);
+        }
+        catch (const std::invalid_argument &)
+        {
+            rejected = true;
+        }
+        check("make_shared_aligned<T[]>(n, 48) throws invalid_argument", rejected);
+    }
+    check_allocs("shared_ptr<T[]>(new T[n])", 2, [] { shared_ptr<widget[]> sp{ new widget[16] }; });
+    check_allocs("make_shared_for_overwrite<T>()", 1, [] { auto sp = make_shared_for_overwrite<widget>(); });
+    check_allocs("make_shared_for_overwrite<T[]>(n)", 1, [] { auto sp = make_shared_for_overwrite<widget[]>(16); });
+    check_allocs("make_shared_for_overwrite<T[N]>()", 1, [] { auto sp = make_shared_for_overwrite<widget[16]>(); });
+    check_allocs("make_shared_lazy_weak<T>()", 1, [] { auto sp = smart_ptr::make_shared_lazy_weak<widget>(); });
+    check_allocs("make_shared_lazy_weak<T>() + weak_ptr", 2, [] {
+        auto sp = smart_ptr::make_shared_lazy_weak<widget>();
+        weak_ptr<widget> wp{ sp };
+    });
+
+    {
+        auto sp = make_shared<widget>();
+        weak_ptr<widget> wp{ sp };
+        shared_ptr<widget> other = make_shared<widget>();
+        check_allocs("shared_ptr(const shared_ptr&)", 0, [&] { shared_ptr<widget> c{ sp }; });
+        check_allocs("shared_ptr(shared_ptr&&)", 0, [&] {
+            shared_ptr<widget> c{ sp };
+            shared_ptr<widget> m{ std::move(c) };
+        });
+        check_allocs("shared_ptr<const T>(const shared_ptr<T>&)", 0, [&] { shared_ptr<const widget> c{ sp }; });
+        check_allocs("aliasing shared_ptr(sp, p)", 0, [&] { shared_ptr<long> a{ sp, &sp->b }; });
+        check_allocs("shared_ptr(const weak_ptr&)", 0, [&] { shared_ptr<widget> c{ wp }; });
+        check_allocs("operator=(const shared_ptr&)", 0, [&] {
+            shared_ptr<widget> c;
+            c = sp;
+            c = other;
+        });
+        check_allocs("reset()", 0, [&] {
+            shared_ptr<widget> c{ sp };
+            c.reset();
+        });
+        check_allocs("weak_ptr(const shared_ptr&)", 0, [&] { weak_ptr<widget> w{ sp }; });
+        check_allocs("weak_ptr(const weak_ptr&)", 0, [&] { weak_ptr<widget> w{ wp }; });
+        check_allocs("weak_ptr::lock()", 0, [&] { auto l = wp.lock(); });
+        check_allocs("static_pointer_cast", 0, [&] { auto c = smart_ptr::static_pointer_cast<const widget>(sp); });
+    }
+
+    std::printf("\nunique_ptr construction paths\n");
+    check_allocs("unique_ptr()", 0, [] { unique_ptr<widget> up; });
+    check_allocs("unique_ptr(new T)", 1, [] { unique_ptr<widget> up{ new widget{} }; });
+    check_allocs("unique_ptr(new T, lambda)", 1, [&] { unique_ptr<int, stateless_t> up{ new int{}, stateless }; });
+    check_allocs("make_unique<T>()", 1, [] { auto up = make_unique<widget>(); });
+    check_allocs("make_unique<T[]>(n)", 1, [] { auto up = make_unique<widget[]>(16); });
+    check_allocs("make_unique_aligned<T[]>(n, 64)", 1, [] { auto up = make_unique_aligned<float[]>(64, 64); });
+    {
+        bool rejected = false;
+        try
+        {
+            auto up = make_unique_aligned<float[]>(64, 48);
+        }
+        catch (const std::invalid_argument &)
+        {
+            rejected = true;
+        }
+        check("make_unique_aligned<T[]>(n, 48) throws invalid_argument", rejected);
+    }
+    check_allocs("make_unique_for_overwrite<T>()", 1, [] { auto up = make_unique_for_overwrite<widget>(); });
+    check_allocs("make_unique_for_overwrite<T[]>(n)", 1, [] { auto up = make_unique_for_overwrite<widget[]>(16); });
+    check_allocs("unique_ptr(unique_ptr&&)", 1, [] {
+        auto up = make_unique<widget>();
+        unique_ptr<widget> m{ std::move(up) };
+    });
+    check_allocs("unique_ptr::reset(p)", 2, [] {
+        auto up = make_unique<widget>();
+        up.reset(new widget{});
+    });
+
+    std::printf("\npoly_value construction paths\n");
+    check_allocs("make_poly_value<Base, small>()", 0, [] { auto pv = make_poly_value<shape, small_shape>(); });
+    check_allocs("make_poly_value<Base, large>()", 1, [] { auto pv = make_poly_value<shape, large_shape>(); });
+    check_allocs("poly_value(const poly_value&), small", 0, [] {
+        auto pv = make_poly_value<shape, small_shape>();
+        poly_value<shape> c{ pv };
+    });
+    check_allocs("poly_value(poly_value&&), large", 1, [] {
+        auto pv = make_poly_value<shape, large_shape>();
+        poly_value<shape> m{ std::move(pv) };
+    });
+    check_allocs("make_poly_value<Base, alignas(128)>()", 1, [] {
+        auto pv = make_poly_value<shape, aligned128_shape>();
+    });
+    check_allocs("make_poly_value<Base, alignas(128)>(throws)", 1, [] {
+        try
+        {
+            auto pv = make_poly_value<shape, aligned128_shape>(true);
+        }
+        catch (const construction_failure &)
+        {
+        }
+    });
+    {
+        bool aligned = true;
+        for (int i = 0; i < 64; ++i)
+        {
+            auto a = make_poly_value<shape, aligned64_shape>();
+            auto b = make_poly_value<shape, aligned128_shape>();
+            poly_value<shape> c{ b };
+            aligned = aligned && is_aligned(a.get(), 64) && is_aligned(b.get(), 128) && is_aligned(c.get(), 128);
+        }
+        check("poly_value places alignas(64) and alignas(128) types on their boundary", aligned);
+    }
+
+    std::printf("\nstrong_ptr paths\n");
+    check_allocs("make_strong<T>()", 1, [] { auto sp = smart_ptr::make_strong<widget>(); });
+    check_allocs("strong_ptr(const strong_ptr&)", 1, [] {
+        auto sp = smart_ptr::make_strong<widget>();
+        auto copy = sp;
+    });
+    check_allocs("to_shared_ptr(strong_ptr)", 2, [] {
+        auto sp = smart_ptr::make_strong<widget>();
+        shared_ptr<widget> shared = smart_ptr::to_shared_ptr(sp);
+    });
+    check_allocs("to_strong_ptr(shared_ptr)", 2, [] {
+        auto sp = make_shared<widget>();
+        smart_ptr::strong_ptr<widget> strong = smart_ptr::to_strong_ptr(sp);
+    });
+
+    std::printf("\nimmortal objects\n");
+    check_allocs("immortal<widget>::share()", 0, [] {
+        static smart_ptr::immortal<widget> w{};
+        auto sp = w.share();
+        auto copy = sp;
+    });
+    check_allocs("make_immortal_shared(obj)", 0, [] {
+        static widget w{};
+        auto sp = smart_ptr::make_immortal_shared(w);
+        weak_ptr<widget> wp{ sp };
+        auto locked = wp.lock();
+    });
+
+    std::printf("\nshared_bytes paths\n");
+    check_allocs("shared_bytes::allocate(1500)", 1, [] {
+        bytes_pool pool;
+        auto b = shared_bytes::allocate(1500, pool);
+    });
+    check_allocs("shared_bytes::allocate(1500) x8, recycled", 1, [] {
+        bytes_pool pool;
+        for (int i = 0; i < 8; ++i)
+            auto b = shared_bytes::allocate(1500, pool);
+    });
+    check_allocs("shared_bytes::slice()", 1, [] {
+        bytes_pool pool;
+        auto b = shared_bytes::allocate(1500, pool);
+        auto s = b.slice(40);
+    });
+
+    std::printf("\nslot_map after a throwing emplace\n");
+    {
+        using handle_type = smart_ptr::slot_map<throwing_widget>::handle_type;
+        smart_ptr::slot_map<throwing_widget> map;
+        try
+        {
+            map.emplace(true);
+        }
+        catch (const std::runtime_error &)
+        {
+        }
+        check("contains(handle{}) is false", !map.contains(handle_type{}));
+        check("get(handle{}) is nullptr", map.get(handle_type{}) == nullptr);
+        check("erase(handle{}) is false", !map.erase(handle_type{}));
+        handle_type h = map.emplace(false);
+        check("emplace() reuses the free slot", map.contains(h) && map.size() == 1 && h.index() == 0);
+    }
+
+    std::printf("\nsmart pointer sizes\n");
+    const std::size_t ptr = sizeof(void *);
+    check_size("unique_ptr<int>", sizeof(unique_ptr<int>), ptr);
+    check_size("unique_ptr<int[]>", sizeof(unique_ptr<int[]>), ptr);
+    check_size("unique_ptr<int, stateless lambda>", sizeof(unique_ptr<int, stateless_t>), ptr);
+    check_size("unique_ptr<int, void (*)(int *)>", sizeof(unique_ptr<int, void (*)(int *)>), 2 * ptr);
+    check_size("unique_ptr<int, stateful lambda>", sizeof(unique_ptr<int, stateful_t>), ptr + sizeof(stateful_t));
+    check_size("shared_ptr<int>", sizeof(shared_ptr<int>), 2 * ptr);
+    check_size("weak_ptr<int>", sizeof(weak_ptr<int>), 2 * ptr);
+    check_size("strong_ptr<int>", sizeof(smart_ptr::strong_ptr<int>), 2 * ptr);
+    check_size("handle<int>", sizeof(smart_ptr::handle<int>), 8);
+
+    std::printf("\ncontrol block sizes\n");
+    const std::size_t counts = 2 * sizeof(long);
+    check_size("control_block<int>", sizeof(smart_ptr::detail::control_block<int>), ptr + counts + ptr);
+    check_size("control_block<int, stateless lambda>",
+        sizeof(smart_ptr::detail::control_block<int, stateless_t>), ptr + counts + ptr);
+    check_size("control_block<int, void (*)(int *)>",
+        sizeof(smart_ptr::detail::control_block<int, void (*)(int *)>), ptr + counts + 2 * ptr);
+    check_size("control_block<int, stateful lambda>",
+        sizeof(smart_ptr::detail::control_block<int, stateful_t>));
+    check_size("control_block_inplace<int>",
+        sizeof(smart_ptr::detail::control_block_inplace<int>), ptr + counts + ptr);
+    check_size("control_block_lazy_weak<int>",
+        sizeof(smart_ptr::detail::control_block_lazy_weak<int>), ptr + sizeof(long) + ptr);
+    check_size("strong_header", sizeof(smart_ptr::detail::strong_header), sizeof(long) + ptr);
+    check_size("control_block_immortal", sizeof(smart_ptr::detail::control_block_immortal), ptr);
+    check_size("control_block_inplace<widget>",
+        sizeof(smart_ptr::detail::control_block_inplace<widget>), ptr + counts + sizeof(widget));
+
+    if (g_failures)
+    {
+        std::printf("\n%d allocation or size regression(s)\n", g_failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("\nall allocation and size checks passed\n");
+    return EXIT_SUCCESS;
+}
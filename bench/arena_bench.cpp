@@ -0,0 +1,106 @@
+// benchmark of make_shared_in against make_shared
+
+/**
+ * Simulates request handling: each request builds a small object graph
+ *  (a request header, a few dozen fields and some shared buffers that
+ *  reference each other), hands parts of it around and drops it at the
+ *  end of the request. The arena variant resets its arena per request.
+ *
+ * Usage: arena_bench.out [requests]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <chrono>
+
+#include "../smart_ptr.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::make_shared;
+using smart_ptr::make_shared_in;
+using smart_ptr::arena;
+
+namespace
+{
+
+    struct field
+    {
+        long key;
+        long value;
+    };
+
+    struct buffer
+    {
+        char bytes[192];
+        shared_ptr<field> owner;
+    };
+
+    struct request
+    {
+        long id;
+        std::vector<shared_ptr<field>> fields;
+        std::vector<shared_ptr<buffer>> buffers;
+    };
+
+    const int fields_per_request = 48;
+    const int buffers_per_request = 8;
+
+    template<typename T>
+    shared_ptr<T>
+    create(arena *a)
+    {
+        return a ? make_shared_in<T>(*a) : make_shared<T>();
+    }
+
+    long
+    handle_request(long id, arena *a)
+    {
+        shared_ptr<request> req = create<request>(a);
+        req->id = id;
+        req->fields.reserve(fields_per_request);
+        req->buffers.reserve(buffers_per_request);
+        for (int i = 0; i < fields_per_request; ++i)
+        {
+            req->fields.push_back(create<field>(a));
+            req->fields.back()->key = i;
+        }
+        for (int i = 0; i < buffers_per_request; ++i)
+        {
+            req->buffers.push_back(create<buffer>(a));
+            req->buffers.back()->owner = req->fields[i * 5];
+        }
+        long sum = 0;
+        for (auto &f : req->fields)
+            sum += f->key;
+        return sum;
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    long requests = 200000;
+    if (argc > 1)
+        requests = std::strtol(argv[1], nullptr, 10);
+
+    long check = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (long r = 0; r < requests; ++r)
+        check += handle_request(r, nullptr);
+    auto middle = std::chrono::steady_clock::now();
+    arena a;
+    for (long r = 0; r < requests; ++r)
+    {
+        check += handle_request(r, &a);
+        a.reset();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double heap = std::chrono::duration<double, std::nano>(middle - begin).count() / double(requests);
+    double in_arena = std::chrono::duration<double, std::nano>(end - middle).count() / double(requests);
+    std::printf("make_shared    %10.1f ns/request\n", heap);
+    std::printf("make_shared_in %10.1f ns/request (%.2fx)\n", in_arena, heap / in_arena);
+    return check == 0 ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+// benchmark of reference count contention
+
+/**
+ * Runs the multithreaded copy/destroy and weak_ptr::lock scenarios,
+ *  each once with every thread hammering the same control block
+ *  ("shared"), once with a private control block per thread
+ *  ("private") and once on an immortal object, whose control block keeps
+ *  no counts ("immortal"), and reports time and hardware counters per
+ *  operation.
+ *
+ * Usage: contention_bench.out [threads] [iterations per thread]
+ *
+ * Hardware counters come from perf_event_open(2) and are shown as
+ *  "n/a" where the kernel refuses them (containers, VMs,
+ *  perf_event_paranoid > 2). See perf_counters.hpp for how to add a
+ *  model specific HITM event.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "../smart_ptr.hpp"
+#include "perf_counters.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::make_shared;
+
+namespace
+{
+
+    struct payload
+    {
+        long value;
+    };
+
+    // Spins until every worker has arrived, so that thread start-up
+    // is not measured as part of the first worker's loop.
+    class start_gate
+    {
+    public:
+        explicit start_gate(unsigned n) :
+            _waiting{ n }
+        {
+        }
+
+        void
+        arrive_and_wait() noexcept
+        {
+            _waiting.fetch_sub(1);
+            while (_waiting.load() != 0)
+                std::this_thread::yield();
+        }
+
+    private:
+        std::atomic<unsigned> _waiting;
+    };
+
+    void
+    copy_destroy(const shared_ptr<payload> &sp, std::uint64_t iters, start_gate &gate)
+    {
+        gate.arrive_and_wait();
+        for (std::uint64_t i = 0; i < iters; ++i)
+        {
+            shared_ptr<payload> copy{ sp };
+            asm volatile("" : : "r"(copy.get()) : "memory");
+        }
+    }
+
+    void
+    lock_release(const weak_ptr<payload> &wp, std::uint64_t iters, start_gate &gate)
+    {
+        gate.arrive_and_wait();
+        for (std::uint64_t i = 0; i < iters; ++i)
+        {
+            shared_ptr<payload> locked = wp.lock();
+            asm volatile("" : : "r"(locked.get()) : "memory");
+        }
+    }
+
+    template<typename Setup>
+    void
+    run(const char *label, unsigned threads, std::uint64_t iters, Setup setup)
+    {
+        std::vector<std::thread> workers;
+        workers.reserve(threads);
+        start_gate gate{ threads };
+
+        bench::perf_counters counters;
+        counters.start();
+        auto begin = std::chrono::steady_clock::now();
+        for (unsigned t = 0; t < threads; ++t)
+            workers.emplace_back(setup(t, iters, gate));
+        for (auto &w : workers)
+            w.join();
+        auto end = std::chrono::steady_clock::now();
+        counters.stop();
+
+        std::uint64_t ops = std::uint64_t(threads) * iters;
+        double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+        std::printf("%-28s %8.2f ns/op (wall, %u threads)\n", label, ns / double(ops), threads);
+        counters.print_per_op(ops);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    if (threads < 2)
+        threads = 2;
+    std::uint64_t iters = 2000000;
+    if (argc > 1)
+        threads = static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10));
+    if (argc > 2)
+        iters = std::strtoull(argv[2], nullptr, 10);
+
+    {
+        bench::perf_counters probe;
+        if (!probe.any_available())
+            std::printf("note: hardware counters unavailable, reporting timings only\n");
+    }
+
+    auto shared = make_shared<payload>();
+    weak_ptr<payload> shared_weak{ shared };
+
+    static smart_ptr::immortal<payload> singleton{};
+    auto immortal = singleton.share();
+    weak_ptr<payload> immortal_weak{ immortal };
+
+    std::vector<shared_ptr<payload>> privates;
+    std::vector<weak_ptr<payload>> private_weaks;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        privates.push_back(make_shared<payload>());
+        private_weaks.push_back(privates.back());
+    }
+
+    run("copy/destroy (shared)", threads, iters,
+        [&](unsigned, std::uint64_t n, start_gate &g) {
+            return std::thread{ copy_destroy, std::cref(shared), n, std::ref(g) };
+        });
+    run("copy/destroy (private)", threads, iters,
+        [&](unsigned t, std::uint64_t n, start_gate &g) {
+            return std::thread{ copy_destroy, std::cref(privates[t]), n, std::ref(g) };
+        });
+    run("copy/destroy (immortal)", threads, iters,
+        [&](unsigned, std::uint64_t n, start_gate &g) {
+            return std::thread{ copy_destroy, std::cref(immortal), n, std::ref(g) };
+        });
+    run("weak lock/release (shared)", threads, iters,
+        [&](unsigned, std::uint64_t n, start_gate &g) {
+            return std::thread{ lock_release, std::cref(shared_weak), n, std::ref(g) };
+        });
+    run("weak lock/release (private)", threads, iters,
+        [&](unsigned t, std::uint64_t n, start_gate &g) {
+            return std::thread{ lock_release, std::cref(private_weaks[t]), n, std::ref(g) };
+        });
+    run("weak lock/release (immortal)", threads, iters,
+        [&](unsigned, std::uint64_t n, start_gate &g) {
+            return std::thread{ lock_release, std::cref(immortal_weak), n, std::ref(g) };
+        });
+
+    return 0;
+}
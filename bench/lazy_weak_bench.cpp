@@ -0,0 +1,90 @@
+// benchmark of make_shared_lazy_weak against make_shared
+
+/**
+ * Compares make_shared, whose control block carries both counts, with
+ *  make_shared_lazy_weak, whose block keeps a strong count inline and
+ *  allocates a side table for the weak count on the first weak_ptr.
+ *
+ * Reports, single threaded, the time to create and release an object
+ *  that never gets a weak_ptr, to copy and drop a pointer to it, and to
+ *  create one, take a weak_ptr and release both, where the lazy block
+ *  pays for its side table. Also prints the control block sizes.
+ *
+ * Usage: lazy_weak_bench.out [iterations]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+
+#include "../include/lazy_weak.hpp"
+#include "../include/weak_ptr.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+
+namespace
+{
+
+    using clock_type = std::chrono::steady_clock;
+
+    struct payload
+    {
+        long value;
+    };
+
+    template<typename F>
+    double
+    ns_per(std::size_t n, F f)
+    {
+        double best = 1e300;
+        for (int run = 0; run < 5; ++run)
+        {
+            auto begin = clock_type::now();
+            for (std::size_t i = 0; i < n; ++i)
+                f(i);
+            best = std::min(best, std::chrono::duration<double, std::nano>(clock_type::now() - begin).count());
+        }
+        return best / double(n);
+    }
+
+    template<typename Make>
+    void
+    report(const char *name, std::size_t n, Make make)
+    {
+        double create = ns_per(n, [&](std::size_t i) {
+            shared_ptr<payload> p = make(long(i));
+            asm volatile("" : : "r"(p.get()) : "memory");
+        });
+        shared_ptr<payload> p = make(0L);
+        double copy = ns_per(n, [&](std::size_t) {
+            shared_ptr<payload> c{ p };
+            asm volatile("" : : "r"(c.get()) : "memory");
+        });
+        double weak = ns_per(n, [&](std::size_t i) {
+            shared_ptr<payload> s = make(long(i));
+            weak_ptr<payload> w{ s };
+            asm volatile("" : : "r"(s.get()) : "memory");
+        });
+        std::printf("%-28s %12.2f %12.2f %12.2f\n", name, create, copy, weak);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t n = 2000000;
+    if (argc > 1)
+        n = std::strtoul(argv[1], nullptr, 10);
+
+    std::printf("%-28s %12s %12s %12s\n", "ns per operation", "create/drop", "copy/drop", "with weak");
+    report("make_shared", n, [](long v) { return smart_ptr::make_shared<payload>(payload{ v }); });
+    report("make_shared_lazy_weak", n, [](long v) { return smart_ptr::make_shared_lazy_weak<payload>(payload{ v }); });
+
+    std::printf("\ncontrol block bytes: make_shared %zu, make_shared_lazy_weak %zu (+%zu side table)\n",
+        sizeof(smart_ptr::detail::control_block_inplace<payload>),
+        sizeof(smart_ptr::detail::control_block_lazy_weak<payload>),
+        sizeof(smart_ptr::detail::lazy_weak_side_table));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+// benchmark of map_file_shared against read() into a heap buffer
+
+/**
+ * Writes a temporary file, then repeatedly loads it and sums its bytes,
+ *  once with read() into a heap buffer (the kernel copies every byte out
+ *  of the page cache) and once with map_file_shared (the page cache is
+ *  mapped, nothing is copied), with the sequential and willneed hints.
+ *  The file stays in the page cache, so this measures the copy and the
+ *  page faults, not the disk. Reports the best of a few runs.
+ *
+ * Then splits the loaded file into fixed-size records, as a parser
+ *  handing out fields would, once copying each record into a std::string
+ *  and once slicing the shared_buffer.
+ *
+ * Usage: map_file_bench.out [file MiB]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../include/shared_buffer.hpp"
+
+using smart_ptr::shared_buffer;
+using smart_ptr::map_file_shared;
+using smart_ptr::access_advice;
+
+namespace
+{
+
+    using clock_type = std::chrono::steady_clock;
+
+    double
+    seconds_since(clock_type::time_point begin)
+    {
+        return std::chrono::duration<double>(clock_type::now() - begin).count();
+    }
+
+    unsigned long
+    checksum(const unsigned char *p, std::size_t n)
+    {
+        unsigned long sum = 0;
+        for (std::size_t i = 0; i < n; ++i)
+            sum += p[i];
+        return sum;
+    }
+
+    unsigned long
+    load_with_read(const char *path, std::size_t size)
+    {
+        std::vector<unsigned char> buf(size);
+        int fd = ::open(path, O_RDONLY);
+        std::size_t done = 0;
+        while (done < size)
+        {
+            ssize_t n = ::read(fd, buf.data() + done, size - done);
+            if (n <= 0)
+                break;
+            done += std::size_t(n);
+        }
+        ::close(fd);
+        return checksum(buf.data(), done);
+    }
+
+    unsigned long
+    load_with_map(const char *path, access_advice advice)
+    {
+        shared_buffer b = map_file_shared(path, advice);
+        return checksum(b.data(), b.size());
+    }
+
+    template<typename F>
+    double
+    best_gib_per_s(std::size_t size, unsigned long expected, F f)
+    {
+        double best = 1e300;
+        for (int run = 0; run < 5; ++run)
+        {
+            auto begin = clock_type::now();
+            if (f() != expected)
+                std::exit(EXIT_FAILURE);
+            best = std::min(best, seconds_since(begin));
+        }
+        return double(size) / best / double(1 << 30);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t mib = 64;
+    if (argc > 1)
+        mib = std::strtoul(argv[1], nullptr, 10);
+    std::size_t size = mib << 20;
+
+    char path[] = "/tmp/map_file_bench.XXXXXX";
+    int fd = ::mkstemp(path);
+    if (fd < 0)
+        return EXIT_FAILURE;
+    std::vector<unsigned char> content(size);
+    for (std::size_t i = 0; i < size; ++i)
+        content[i] = static_cast<unsigned char>(i * 131 + (i >> 12));
+    if (::write(fd, content.data(), size) != ssize_t(size))
+        return EXIT_FAILURE;
+    ::close(fd);
+    unsigned long expected = checksum(content.data(), size);
+    content.clear();
+    content.shrink_to_fit();
+
+    std::printf("%-36s %10s\n", "load and sum", "GiB/s");
+    std::printf("%-36s %10.2f\n", "read() into a heap buffer",
+        best_gib_per_s(size, expected, [&] { return load_with_read(path, size); }));
+    std::printf("%-36s %10.2f\n", "map_file_shared, sequential",
+        best_gib_per_s(size, expected, [&] { return load_with_map(path, access_advice::sequential); }));
+    std::printf("%-36s %10.2f\n", "map_file_shared, willneed",
+        best_gib_per_s(size, expected, [&] { return load_with_map(path, access_advice::willneed); }));
+
+    shared_buffer file = map_file_shared(path, access_advice::willneed);
+    if (checksum(file.data(), file.size()) != expected) // also faults every page in
+        return EXIT_FAILURE;
+    const std::size_t record = 256;
+    std::size_t records = file.size() / record;
+    unsigned long sink = 0;
+
+    auto begin = clock_type::now();
+    {
+        std::vector<std::string> copies;
+        copies.reserve(records);
+        for (std::size_t i = 0; i < records; ++i)
+            copies.emplace_back(reinterpret_cast<const char *>(file.data() + i * record), record);
+        for (const auto &c : copies)
+            sink += static_cast<unsigned char>(c[0]);
+    }
+    double copy_ns = seconds_since(begin) * 1e9 / double(records);
+
+    begin = clock_type::now();
+    {
+        std::vector<shared_buffer> slices;
+        slices.reserve(records);
+        for (std::size_t i = 0; i < records; ++i)
+            slices.push_back(file.slice(i * record, record));
+        for (const auto &s : slices)
+            sink -= s[0];
+    }
+    double slice_ns = seconds_since(begin) * 1e9 / double(records);
+
+    std::printf("\n%-36s %10s\n", "256-byte records", "ns/record");
+    std::printf("%-36s %10.2f\n", "copied into std::string", copy_ns);
+    std::printf("%-36s %10.2f\n", "shared_buffer::slice", slice_ns);
+
+    ::unlink(path);
+    return sink == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,114 @@
+// benchmark of owner_flat_map against std::map with owner_less
+
+/**
+ * Builds an owner-keyed map from weak_ptrs to ints, once as
+ *  std::map<weak_ptr<T>, int, owner_less<weak_ptr<T>>> and once as
+ *  owner_flat_map<weak_ptr<T>, int> filled by one bulk insert, then
+ *  times random lookups (half hits, half misses) and a full iteration
+ *  summing the mapped values, for growing map sizes.
+ *
+ * Usage: owner_flat_bench.out [lookups]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <utility>
+#include <random>
+#include <algorithm>
+
+#include "../smart_ptr.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::make_shared;
+using smart_ptr::owner_less;
+using smart_ptr::owner_flat_map;
+
+namespace
+{
+
+    struct observer
+    {
+        long id;
+    };
+
+    using clock_type = std::chrono::steady_clock;
+
+    double
+    ns_since(clock_type::time_point begin, std::size_t ops)
+    {
+        return std::chrono::duration<double, std::nano>(clock_type::now() - begin).count() / double(ops);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t lookups = 2000000;
+    if (argc > 1)
+        lookups = std::strtoul(argv[1], nullptr, 10);
+
+    std::mt19937_64 rng{ 42 };
+    long sink = 0;
+    std::printf("%8s %16s %16s %16s %16s\n", "size",
+        "map find ns/op", "flat find ns/op", "map iter ns/el", "flat iter ns/el");
+    for (std::size_t n : { 16u, 64u, 256u, 1024u, 4096u })
+    {
+        std::vector<shared_ptr<observer>> owners;
+        for (std::size_t i = 0; i < 2 * n; ++i)
+            owners.push_back(make_shared<observer>(long(i)));
+        std::shuffle(owners.begin(), owners.end(), rng); // scatter the control blocks
+
+        std::map<weak_ptr<observer>, int, owner_less<weak_ptr<observer>>> tree;
+        std::vector<std::pair<weak_ptr<observer>, int>> rows;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            tree.emplace(owners[i], int(i));
+            rows.emplace_back(owners[i], int(i));
+        }
+        owner_flat_map<weak_ptr<observer>, int> flat;
+        flat.insert(rows.begin(), rows.end());
+        if (flat.size() != tree.size())
+            return 1;
+
+        // long random probe sequence, so the branch predictor cannot learn it
+        std::vector<weak_ptr<observer>> probes;
+        for (std::size_t i = 0; i < 65536; ++i)
+            probes.push_back(owners[rng() % owners.size()]);
+
+        auto begin = clock_type::now();
+        for (std::size_t i = 0; i < lookups; ++i)
+        {
+            auto it = tree.find(probes[i % probes.size()]);
+            sink += (it != tree.end()) ? it->second : 0;
+        }
+        double tree_find = ns_since(begin, lookups);
+
+        begin = clock_type::now();
+        for (std::size_t i = 0; i < lookups; ++i)
+        {
+            const int *v = flat.find(probes[i % probes.size()]);
+            sink -= v ? *v : 0;
+        }
+        double flat_find = ns_since(begin, lookups);
+
+        std::size_t rounds = lookups / n + 1;
+        begin = clock_type::now();
+        for (std::size_t r = 0; r < rounds; ++r)
+            for (const auto &kv : tree)
+                sink += kv.second;
+        double tree_iter = ns_since(begin, rounds * n);
+
+        begin = clock_type::now();
+        for (std::size_t r = 0; r < rounds; ++r)
+            for (int v : flat.values())
+                sink -= v;
+        double flat_iter = ns_since(begin, rounds * n);
+
+        std::printf("%8zu %16.2f %16.2f %16.2f %16.2f\n", n, tree_find, flat_find, tree_iter, flat_iter);
+    }
+    return sink == 0 ? 0 : 1; // both containers must agree
+}
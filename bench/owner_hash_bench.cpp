@@ -0,0 +1,85 @@
+// benchmark of owner_hash/owner_equal against owner_less
+
+/**
+ * Looks up weak_ptrs in an owner-keyed set, once in
+ *  std::set<weak_ptr<T>, owner_less<weak_ptr<T>>> and once in
+ *  std::unordered_set<weak_ptr<T>, owner_hash, owner_equal>, for
+ *  growing set sizes. Lookups are done in shuffled order with a mix of
+ *  hits and misses.
+ *
+ * Usage: owner_hash_bench.out [lookups]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <set>
+#include <unordered_set>
+#include <random>
+#include <algorithm>
+
+#include "../smart_ptr.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::make_shared;
+using smart_ptr::owner_less;
+using smart_ptr::owner_hash;
+using smart_ptr::owner_equal;
+
+namespace
+{
+
+    struct observer
+    {
+        long id;
+    };
+
+    template<typename Set>
+    double
+    time_lookups(const Set &set, const std::vector<weak_ptr<observer>> &probes,
+        std::size_t lookups, std::size_t &found)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < lookups; ++i)
+            found += set.count(probes[i % probes.size()]);
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - begin).count() / double(lookups);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t lookups = 2000000;
+    if (argc > 1)
+        lookups = std::strtoul(argv[1], nullptr, 10);
+
+    std::mt19937_64 rng{ 42 };
+    std::size_t found = 0;
+    std::printf("%10s %22s %22s\n", "size", "owner_less set ns/op", "owner_hash set ns/op");
+    for (std::size_t n : { 16u, 256u, 4096u, 65536u, 262144u })
+    {
+        std::vector<shared_ptr<observer>> owners;
+        for (std::size_t i = 0; i < 2 * n; ++i)
+            owners.push_back(make_shared<observer>(long(i)));
+        std::shuffle(owners.begin(), owners.end(), rng); // scatter the control blocks
+
+        std::set<weak_ptr<observer>, owner_less<weak_ptr<observer>>> ordered;
+        std::unordered_set<weak_ptr<observer>, owner_hash, owner_equal> unordered;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            ordered.insert(owners[i]);
+            unordered.insert(owners[i]);
+        }
+
+        std::vector<weak_ptr<observer>> probes(owners.begin(), owners.end()); // half hits, half misses
+        std::shuffle(probes.begin(), probes.end(), rng);
+
+        double tree = time_lookups(ordered, probes, lookups, found);
+        double hash = time_lookups(unordered, probes, lookups, found);
+        std::printf("%10zu %22.2f %22.2f\n", n, tree, hash);
+    }
+    return found ? 0 : 1;
+}
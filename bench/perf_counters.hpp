@@ -0,0 +1,185 @@
+// perf_event hardware counters for the benchmarks
+
+/**
+ * Thin wrapper around Linux perf_event_open(2). Each counter is opened
+ *  on the calling thread with inherit set, so threads spawned after
+ *  start() are counted as well and their counts are folded back into
+ *  the parent when they exit. Read the counters after joining.
+ *
+ * Counters that cannot be opened (no PMU in a container or VM,
+ *  perf_event_paranoid too strict, unsupported event) are reported as
+ *  unavailable instead of failing the benchmark.
+ *
+ * HITM (modified-line snoop hit) events are model specific, so no
+ *  generic encoding exists. Set SMART_PTR_PERF_RAW to a raw event code
+ *  (e.g. 0x04d2 for MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM on Skylake) to
+ *  count it as the "coherence" counter.
+ */
+
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP 1
+
+#include <cstdint> // uint64_t
+#include <cstdlib> // getenv, strtoull
+#include <cstring> // memset
+#include <cstdio> // printf
+
+#if defined(__linux__)
+#include <unistd.h> // syscall, read, close
+#include <sys/ioctl.h> // ioctl
+#include <sys/syscall.h> // SYS_perf_event_open
+#include <linux/perf_event.h> // perf_event_attr
+#endif
+
+namespace bench
+{
+
+    class perf_counters
+    {
+    public:
+        enum counter
+        {
+            cycles,
+            instructions,
+            cache_misses,
+            l1d_misses,
+            coherence,
+            counter_count
+        };
+
+        perf_counters()
+        {
+            for (int i = 0; i < counter_count; ++i)
+            {
+                _fd[i] = -1;
+                _value[i] = 0;
+            }
+#if defined(__linux__)
+            _fd[cycles] = _open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+            _fd[instructions] = _open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+            _fd[cache_misses] = _open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+            _fd[l1d_misses] = _open(PERF_TYPE_HW_CACHE,
+                PERF_COUNT_HW_CACHE_L1D
+                    | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+            if (const char *raw = std::getenv("SMART_PTR_PERF_RAW"))
+                _fd[coherence] = _open(PERF_TYPE_RAW, std::strtoull(raw, nullptr, 0));
+#endif
+        }
+
+        ~perf_counters()
+        {
+#if defined(__linux__)
+            for (int i = 0; i < counter_count; ++i)
+                if (_fd[i] >= 0)
+                    ::close(_fd[i]);
+#endif
+        }
+
+        perf_counters(const perf_counters &) = delete;
+        perf_counters &operator=(const perf_counters &) = delete;
+
+        /// Whether at least one counter could be opened
+        bool
+        any_available() const noexcept
+        {
+            for (int i = 0; i < counter_count; ++i)
+                if (_fd[i] >= 0)
+                    return true;
+            return false;
+        }
+
+        bool
+        available(counter c) const noexcept
+        {
+            return _fd[c] >= 0;
+        }
+
+        /// Resets and enables every open counter
+        void
+        start() noexcept
+        {
+#if defined(__linux__)
+            for (int i = 0; i < counter_count; ++i)
+                if (_fd[i] >= 0)
+                {
+                    ::ioctl(_fd[i], PERF_EVENT_IOC_RESET, 0);
+                    ::ioctl(_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+                }
+#endif
+        }
+
+        /// Disables every open counter and latches its value
+        void
+        stop() noexcept
+        {
+#if defined(__linux__)
+            for (int i = 0; i < counter_count; ++i)
+                if (_fd[i] >= 0)
+                {
+                    ::ioctl(_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+                    std::uint64_t v = 0;
+                    if (::read(_fd[i], &v, sizeof(v)) == sizeof(v))
+                        _value[i] = v;
+                }
+#endif
+        }
+
+        std::uint64_t
+        value(counter c) const noexcept
+        {
+            return _value[c];
+        }
+
+        static const char *
+        name(counter c) noexcept
+        {
+            static const char *const names[counter_count] = {
+                "cycles", "instructions", "cache-misses", "L1d-misses", "coherence(raw)"
+            };
+            return names[c];
+        }
+
+        /// Prints every counter divided by ops, "n/a" for unavailable ones
+        void
+        print_per_op(std::uint64_t ops) const
+        {
+            for (int i = 0; i < counter_count; ++i)
+            {
+                counter c = static_cast<counter>(i);
+                if (c == coherence && _fd[c] < 0 && !std::getenv("SMART_PTR_PERF_RAW"))
+                    continue;
+                if (_fd[c] >= 0)
+                    std::printf("    %-16s %10.2f /op\n", name(c),
+                        ops ? double(_value[c]) / double(ops) : 0.0);
+                else
+                    std::printf("    %-16s %10s\n", name(c), "n/a");
+            }
+        }
+
+    private:
+#if defined(__linux__)
+        static int
+        _open(std::uint32_t type, std::uint64_t config) noexcept
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            long fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            return static_cast<int>(fd);
+        }
+#endif
+
+        int _fd[counter_count];
+        std::uint64_t _value[counter_count];
+    };
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,152 @@
+// benchmark of poly_value against unique_ptr for small polymorphic objects
+
+/**
+ * Fills a vector with strategy objects of three small derived types,
+ *  once as unique_ptr<Base> and once as poly_value<Base>, and times
+ *  building the vector and calling a virtual member on every element.
+ *  The unique_ptr objects are allocated interleaved with unrelated
+ *  allocations, as they would be in a long running program, so they are
+ *  not contiguous in memory.
+ *
+ * Usage: poly_value_bench.out [rounds]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <memory>
+
+#include "../smart_ptr.hpp"
+
+using smart_ptr::unique_ptr;
+using smart_ptr::make_unique;
+using smart_ptr::poly_value;
+using smart_ptr::make_poly_value;
+
+namespace
+{
+
+    struct strategy
+    {
+        virtual ~strategy() = default;
+        virtual long apply(long x) const = 0;
+    };
+
+    struct add : strategy
+    {
+        long k;
+        explicit add(long k) : k{ k } {}
+        long apply(long x) const override { return x + k; }
+    };
+
+    struct scale : strategy
+    {
+        long k;
+        long bias;
+        scale(long k, long bias) : k{ k }, bias{ bias } {}
+        long apply(long x) const override { return x * k + bias; }
+    };
+
+    struct clamp : strategy
+    {
+        long lo;
+        long hi;
+        long pad[3];
+        clamp(long lo, long hi) : lo{ lo }, hi{ hi }, pad{} {}
+        long apply(long x) const override { return x < lo ? lo : (x > hi ? hi : x); }
+    };
+
+    using clock_type = std::chrono::steady_clock;
+
+    double
+    ns_since(clock_type::time_point begin, std::size_t ops)
+    {
+        return std::chrono::duration<double, std::nano>(clock_type::now() - begin).count() / double(ops);
+    }
+
+    const std::size_t count = 4096;
+
+    template<typename P, typename Make>
+    void
+    fill(std::vector<P> &v, std::vector<std::unique_ptr<char[]>> *noise, Make make)
+    {
+        v.clear();
+        v.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            v.push_back(make(i));
+            if (noise)
+                noise->emplace_back(new char[32 + (i % 7) * 16]);
+        }
+    }
+
+    template<typename P>
+    long
+    run(const std::vector<P> &v)
+    {
+        long x = 1;
+        for (const auto &p : v)
+            x = p->apply(x) & 0xffff;
+        return x;
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t rounds = 2000;
+    if (argc > 1)
+        rounds = std::strtoul(argv[1], nullptr, 10);
+
+    auto make_up = [](std::size_t i) -> unique_ptr<strategy> {
+        switch (i % 3)
+        {
+            case 0: return make_unique<add>(long(i));
+            case 1: return make_unique<scale>(3L, long(i));
+            default: return make_unique<clamp>(0L, 1000L);
+        }
+    };
+    auto make_pv = [](std::size_t i) -> poly_value<strategy> {
+        switch (i % 3)
+        {
+            case 0: return make_poly_value<strategy, add>(long(i));
+            case 1: return make_poly_value<strategy, scale>(3L, long(i));
+            default: return make_poly_value<strategy, clamp>(0L, 1000L);
+        }
+    };
+
+    std::vector<unique_ptr<strategy>> ups;
+    std::vector<poly_value<strategy>> pvs;
+    std::vector<std::unique_ptr<char[]>> noise;
+
+    std::size_t builds = rounds / 20 + 1;
+    auto begin = clock_type::now();
+    for (std::size_t r = 0; r < builds; ++r)
+        fill(ups, nullptr, make_up);
+    double up_build = ns_since(begin, builds * count);
+
+    begin = clock_type::now();
+    for (std::size_t r = 0; r < builds; ++r)
+        fill(pvs, nullptr, make_pv);
+    double pv_build = ns_since(begin, builds * count);
+
+    // rebuild the unique_ptrs interleaved with live noise allocations
+    fill(ups, &noise, make_up);
+
+    long sink = 0;
+    begin = clock_type::now();
+    for (std::size_t r = 0; r < rounds; ++r)
+        sink += run(ups);
+    double up_call = ns_since(begin, rounds * count);
+
+    begin = clock_type::now();
+    for (std::size_t r = 0; r < rounds; ++r)
+        sink -= run(pvs);
+    double pv_call = ns_since(begin, rounds * count);
+
+    std::printf("%-24s %14s %14s\n", "", "build ns/el", "call ns/el");
+    std::printf("%-24s %14.2f %14.2f\n", "unique_ptr<Base>", up_build, up_call);
+    std::printf("%-24s %14.2f %14.2f\n", "poly_value<Base, 48>", pv_build, pv_call);
+    return sink == 0 ? 0 : 1; // both must compute the same result
+}
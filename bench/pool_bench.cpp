@@ -0,0 +1,100 @@
+// benchmark of shared_pool against make_shared
+
+/**
+ * Churns message objects that own a large buffer, the pattern shared_pool
+ *  is meant for: every iteration acquires a few messages, touches them
+ *  and drops them again. Runs single threaded and with several threads
+ *  sharing one pool, and prints the pool hit rate.
+ *
+ * Usage: pool_bench.out [threads] [iterations per thread]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "../smart_ptr.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::make_shared;
+using smart_ptr::shared_pool;
+
+namespace
+{
+
+    struct message
+    {
+        message() :
+            payload(4096)
+        {
+        }
+
+        std::vector<char> payload;
+        std::size_t length = 0;
+    };
+
+    const int batch = 8;
+
+    template<typename Acquire>
+    void
+    churn(Acquire acquire, std::uint64_t iters)
+    {
+        shared_ptr<message> live[batch];
+        for (std::uint64_t i = 0; i < iters; ++i)
+        {
+            for (int j = 0; j < batch; ++j)
+            {
+                live[j] = acquire();
+                live[j]->payload[0] = char(i);
+                live[j]->length = 1;
+            }
+            for (int j = 0; j < batch; ++j)
+                live[j].reset();
+        }
+    }
+
+    template<typename Acquire>
+    double
+    run(unsigned threads, std::uint64_t iters, Acquire acquire)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t)
+            workers.emplace_back([&] { churn(acquire, iters); });
+        for (auto &w : workers)
+            w.join();
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+        return ns / double(std::uint64_t(threads) * iters * batch);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    if (threads < 2)
+        threads = 2;
+    std::uint64_t iters = 200000;
+    if (argc > 1)
+        threads = static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10));
+    if (argc > 2)
+        iters = std::strtoull(argv[2], nullptr, 10);
+
+    for (unsigned n : { 1u, threads })
+    {
+        double heap = run(n, iters, [] { return make_shared<message>(); });
+
+        shared_pool<message> pool{ [](message &m) { m.length = 0; } };
+        double pooled = run(n, iters, [&] { return pool.acquire(); });
+        smart_ptr::pool_stats stats = pool.stats();
+
+        std::printf("%u thread(s): make_shared %8.2f ns/op, shared_pool %8.2f ns/op, "
+                    "hit rate %.4f (%llu misses)\n",
+            n, heap, pooled, stats.hit_rate(), (unsigned long long)stats.misses);
+    }
+    return 0;
+}
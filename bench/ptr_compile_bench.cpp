@@ -0,0 +1,105 @@
+// compile time benchmark of the storage of detail::Ptr
+
+/**
+ * Only compiled, never run: instantiates the pointer and deleter storage
+ *  for ptr_compile_count distinct pointer and deleter types and calls
+ *  every accessor, once with the current detail::Ptr and, when built
+ *  with -DPTR_COMPILE_BENCH_TUPLE, with the former std::tuple storage.
+ *  "make compile_bench" times both with -fsyntax-only.
+ */
+
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+#include "../include/ptr.hpp"
+
+namespace
+{
+
+    const std::size_t ptr_compile_count = 400;
+
+    template<std::size_t I>
+    struct object
+    {
+        long value;
+    };
+
+    template<std::size_t I>
+    struct deleter
+    {
+        void
+        operator()(object<I> *p) const
+        {
+            delete p;
+        }
+    };
+
+#if defined(PTR_COMPILE_BENCH_TUPLE)
+    template<typename T, typename D>
+    class storage
+    {
+    public:
+        explicit storage(T *p) :
+            _impl_t{ p, D{} }
+        {
+        }
+
+        T *&_impl_ptr() { return std::get<0>(_impl_t); }
+        T *_impl_ptr() const { return std::get<0>(_impl_t); }
+        D &_impl_deleter() { return std::get<1>(_impl_t); }
+        const D &_impl_deleter() const { return std::get<1>(_impl_t); }
+
+    private:
+        std::tuple<T *, D> _impl_t;
+    };
+#else
+    template<typename T, typename D>
+    using storage = smart_ptr::detail::Ptr<T, D>;
+#endif
+
+    template<std::size_t I>
+    long
+    use()
+    {
+        storage<object<I>, deleter<I>> s{ new object<I>{ long(I) } };
+        const auto &cs = s;
+        long v = cs._impl_ptr()->value;
+        s._impl_deleter()(s._impl_ptr());
+        (void)cs._impl_deleter();
+        return v;
+    }
+
+    template<std::size_t... I>
+    struct index_list
+    {
+    };
+
+    template<std::size_t N, std::size_t... I>
+    struct make_index_list : make_index_list<N - 1, N - 1, I...>
+    {
+    };
+
+    template<std::size_t... I>
+    struct make_index_list<0, I...>
+    {
+        using type = index_list<I...>;
+    };
+
+    template<std::size_t... I>
+    long
+    use_all(index_list<I...>)
+    {
+        long sum = 0;
+        long values[] = { use<I>()... };
+        for (long v : values)
+            sum += v;
+        return sum;
+    }
+
+} // namespace
+
+int main()
+{
+    return int(use_all(make_index_list<ptr_compile_count>::type{}) & 1);
+}
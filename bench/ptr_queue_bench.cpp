@@ -0,0 +1,239 @@
+// benchmark of mpmc_ptr_queue and spsc_ptr_queue against a locked std::queue
+
+/**
+ * Throughput: producers hand shared_ptr<job>s to consumers, which drop
+ *  them, through a mutex-protected std::queue (pushing copies, as code
+ *  that keeps its own reference does, then pushing moved pointers), through
+ *  mpmc_ptr_queue and, with one producer and one consumer, through
+ *  spsc_ptr_queue. The jobs are made before the clock starts, so the
+ *  time is the hand-off plus the final release in the consumer.
+ *
+ * Latency: two threads bounce one shared_ptr back and forth through a
+ *  pair of queues, the one-way latency is half of each round trip.
+ *  Reports the median and the 99th percentile.
+ *
+ * Waiting sides yield, so the numbers stay meaningful on machines with
+ *  fewer cores than threads, where they mostly measure the scheduler.
+ *
+ * Usage: ptr_queue_bench.out [hops per producer] [round trips]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "../include/ptr_queue.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::mpmc_ptr_queue;
+using smart_ptr::spsc_ptr_queue;
+
+namespace
+{
+
+    using clock_type = std::chrono::steady_clock;
+
+    struct job
+    {
+        long id;
+    };
+
+    using job_ptr = shared_ptr<job>;
+
+    // mutex-protected std::queue with the same interface as the queues
+    class locked_queue
+    {
+    public:
+        explicit locked_queue(std::size_t)
+        {
+        }
+
+        bool
+        try_push(const job_ptr &p)
+        {
+            std::lock_guard<std::mutex> lock{ _mutex };
+            _queue.push(p);
+            return true;
+        }
+
+        bool
+        try_push(job_ptr &&p)
+        {
+            std::lock_guard<std::mutex> lock{ _mutex };
+            _queue.push(std::move(p));
+            return true;
+        }
+
+        bool
+        try_pop(job_ptr &p)
+        {
+            std::lock_guard<std::mutex> lock{ _mutex };
+            if (_queue.empty())
+                return false;
+            p = std::move(_queue.front());
+            _queue.pop();
+            return true;
+        }
+
+    private:
+        std::mutex _mutex;
+        std::queue<job_ptr> _queue;
+    };
+
+    template<typename Q>
+    void
+    push(Q &q, job_ptr &p, bool copy)
+    {
+        if (copy)
+        {
+            while (!q.try_push(static_cast<const job_ptr &>(p)))
+                std::this_thread::yield();
+        }
+        else
+        {
+            while (!q.try_push(std::move(p)))
+                std::this_thread::yield();
+        }
+    }
+
+    // the lock-free queues only take rvalues, a copy is made by the caller
+    template<typename P>
+    void
+    push(mpmc_ptr_queue<P> &q, job_ptr &p, bool copy)
+    {
+        job_ptr m = copy ? p : std::move(p);
+        while (!q.try_push(std::move(m)))
+            std::this_thread::yield();
+    }
+
+    template<typename P>
+    void
+    push(spsc_ptr_queue<P> &q, job_ptr &p, bool copy)
+    {
+        job_ptr m = copy ? p : std::move(p);
+        while (!q.try_push(std::move(m)))
+            std::this_thread::yield();
+    }
+
+    /// Millions of hops per second from producers to consumers
+    template<typename Q>
+    double
+    throughput(unsigned producers, unsigned consumers, std::size_t hops, bool copy)
+    {
+        Q q{ 1024 };
+        std::vector<std::vector<job_ptr>> jobs(producers);
+        for (auto &v : jobs)
+            for (std::size_t i = 0; i < hops; ++i)
+                v.push_back(smart_ptr::make_shared<job>(job{ long(i) }));
+
+        std::size_t total = producers * hops;
+        std::size_t per_consumer = total / consumers;
+        std::vector<std::thread> threads;
+        auto begin = clock_type::now();
+        for (unsigned c = 0; c < consumers; ++c)
+        {
+            std::size_t n = per_consumer + (c == 0 ? total % consumers : 0);
+            threads.emplace_back([&q, n] {
+                job_ptr p;
+                for (std::size_t got = 0; got < n;)
+                {
+                    if (q.try_pop(p))
+                    {
+                        p.reset();
+                        ++got;
+                    }
+                    else
+                        std::this_thread::yield();
+                }
+            });
+        }
+        for (unsigned t = 0; t < producers; ++t)
+        {
+            threads.emplace_back([&q, &jobs, t, copy] {
+                for (auto &p : jobs[t])
+                {
+                    push(q, p, copy);
+                    if (copy)
+                        p.reset(); // the producer's own reference, dropped after the hand-off
+                }
+            });
+        }
+        for (auto &th : threads)
+            th.join();
+        double s = std::chrono::duration<double>(clock_type::now() - begin).count();
+        return double(total) / s / 1e6;
+    }
+
+    /// One-way latencies in ns of a pointer bounced between two threads
+    template<typename Q>
+    std::vector<double>
+    latency(std::size_t rounds)
+    {
+        Q ping{ 16 };
+        Q pong{ 16 };
+        std::thread echo{ [&] {
+            job_ptr p;
+            for (std::size_t i = 0; i < rounds; ++i)
+            {
+                while (!ping.try_pop(p))
+                    std::this_thread::yield();
+                push(pong, p, false);
+            }
+        } };
+        std::vector<double> samples;
+        samples.reserve(rounds);
+        job_ptr p = smart_ptr::make_shared<job>(job{ 0 });
+        for (std::size_t i = 0; i < rounds; ++i)
+        {
+            auto begin = clock_type::now();
+            push(ping, p, false);
+            while (!pong.try_pop(p))
+                std::this_thread::yield();
+            samples.push_back(std::chrono::duration<double, std::nano>(clock_type::now() - begin).count() / 2);
+        }
+        echo.join();
+        std::sort(samples.begin(), samples.end());
+        return samples;
+    }
+
+    template<typename Q>
+    void
+    report_latency(const char *name, std::size_t rounds)
+    {
+        std::vector<double> s = latency<Q>(rounds);
+        std::printf("%-36s %10.0f %10.0f\n", name, s[s.size() / 2], s[s.size() * 99 / 100]);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t hops = 200000;
+    std::size_t rounds = 20000;
+    if (argc > 1)
+        hops = std::strtoul(argv[1], nullptr, 10);
+    if (argc > 2)
+        rounds = std::strtoul(argv[2], nullptr, 10);
+
+    std::printf("hardware threads: %u\n\n", std::thread::hardware_concurrency());
+    std::printf("%-36s %10s %10s\n", "throughput, Mhops/s", "1p1c", "4p4c");
+    std::printf("%-36s %10.2f %10.2f\n", "mutex + std::queue, copies",
+        throughput<locked_queue>(1, 1, hops, true), throughput<locked_queue>(4, 4, hops, true));
+    std::printf("%-36s %10.2f %10.2f\n", "mutex + std::queue, moves",
+        throughput<locked_queue>(1, 1, hops, false), throughput<locked_queue>(4, 4, hops, false));
+    std::printf("%-36s %10.2f %10.2f\n", "mpmc_ptr_queue",
+        throughput<mpmc_ptr_queue<job_ptr>>(1, 1, hops, false), throughput<mpmc_ptr_queue<job_ptr>>(4, 4, hops, false));
+    std::printf("%-36s %10.2f %10s\n", "spsc_ptr_queue",
+        throughput<spsc_ptr_queue<job_ptr>>(1, 1, hops, false), "-");
+
+    std::printf("\n%-36s %10s %10s\n", "one-way latency, ns", "p50", "p99");
+    report_latency<locked_queue>("mutex + std::queue", rounds);
+    report_latency<mpmc_ptr_queue<job_ptr>>("mpmc_ptr_queue", rounds);
+    report_latency<spsc_ptr_queue<job_ptr>>("spsc_ptr_queue", rounds);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+// benchmark of unique_ptr access in unoptimized builds
+
+/**
+ * Meant to be built at -O0, as debug builds are (see the Makefile).
+ *  Times a loop that dereferences a unique_ptr on every iteration, with
+ *  the current detail::Ptr (compressed_pair storage, accessors forced
+ *  inline) and with a copy of the former one that kept the pointer and
+ *  the deleter in a std::tuple, next to a raw pointer for reference.
+ *
+ * Usage: ptr_storage_bench.out [iterations]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <tuple>
+
+#include "../smart_ptr.hpp"
+
+using smart_ptr::unique_ptr;
+using smart_ptr::default_delete;
+
+namespace
+{
+
+    // the former std::tuple based storage and the unique_ptr accessors
+    // as they were, out of line at -O0
+
+    template<typename T, typename D>
+    class tuple_ptr
+    {
+    public:
+        using pointer = T *;
+
+        explicit tuple_ptr(pointer p) :
+            _impl_t{ p, D{} }
+        {
+        }
+
+        ~tuple_ptr()
+        {
+            std::get<1>(_impl_t)(std::get<0>(_impl_t));
+        }
+
+        pointer
+        _impl_ptr() const
+        {
+            return std::get<0>(_impl_t);
+        }
+
+        T &
+        operator*() const noexcept
+        {
+            auto _ptr = _impl_ptr();
+            return *_ptr;
+        }
+
+    private:
+        std::tuple<pointer, D> _impl_t;
+    };
+
+    using clock_type = std::chrono::steady_clock;
+
+    double
+    ns_since(clock_type::time_point begin, std::size_t ops)
+    {
+        return std::chrono::duration<double, std::nano>(clock_type::now() - begin).count() / double(ops);
+    }
+
+    template<typename P>
+    double
+    time_deref(const P &p, std::size_t iterations, long &sink)
+    {
+        auto begin = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            sink += *p;
+        return ns_since(begin, iterations);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t iterations = 50000000;
+    if (argc > 1)
+        iterations = std::strtoul(argv[1], nullptr, 10);
+
+    long sink = 0;
+    long *raw = new long{ 1 };
+    unique_ptr<long> current{ new long{ 1 } };
+    tuple_ptr<long, default_delete<long>> former{ new long{ 1 } };
+
+    double raw_ns = time_deref(raw, iterations, sink);
+    double current_ns = time_deref(current, iterations, sink);
+    double former_ns = time_deref(former, iterations, sink);
+    delete raw;
+
+    std::printf("%-36s %12s\n", "*p per iteration", "ns");
+    std::printf("%-36s %12.2f\n", "raw pointer", raw_ns);
+    std::printf("%-36s %12.2f\n", "unique_ptr, compressed_pair", current_ns);
+    std::printf("%-36s %12.2f\n", "unique_ptr, std::tuple (former)", former_ns);
+    return sink == long(3 * iterations) ? 0 : 1;
+}
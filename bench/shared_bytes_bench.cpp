@@ -0,0 +1,142 @@
+// benchmark of shared_bytes against shared_ptr<std::vector<char>>
+
+/**
+ * Simulates a receive path: each packet is read into a fresh buffer,
+ *  split into a header and a payload handed to two consumers, and
+ *  released once both are done. The baseline keeps the packet in a
+ *  shared_ptr<std::vector<char>> and copies the sub-ranges out, the
+ *  others slice a shared_bytes, from a bytes_pool and from a pool that
+ *  caches nothing (every buffer goes back to the allocator).
+ *
+ * Replaces the global operator new/delete to count allocations and
+ *  reports them per packet along with the time.
+ *
+ * Usage: shared_bytes_bench.out [packets]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <new>
+#include <vector>
+
+#include "../include/shared_bytes.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::shared_bytes;
+using smart_ptr::bytes_pool;
+
+namespace
+{
+
+    long g_allocs = 0;
+
+} // namespace
+
+void *operator new(std::size_t n)
+{
+    ++g_allocs;
+    if (void *p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc{};
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+namespace
+{
+
+    using clock_type = std::chrono::steady_clock;
+
+    const std::size_t header_size = 40;
+    const std::size_t packet_sizes[] = { 200, 1500, 600, 9000, 64, 1500 };
+
+    unsigned char g_wire[9000]; // stands for the socket, read() copies from it
+
+    void
+    fill(unsigned char *p, std::size_t n, std::size_t seed)
+    {
+        std::memcpy(p, g_wire, n);
+        p[0] = static_cast<unsigned char>(seed);
+    }
+
+    unsigned long
+    consume(const unsigned char *p, std::size_t n)
+    {
+        return p[0] + p[n / 2] + p[n - 1];
+    }
+
+    unsigned long
+    run_vector(std::size_t packets)
+    {
+        unsigned long sink = 0;
+        for (std::size_t i = 0; i < packets; ++i)
+        {
+            std::size_t n = packet_sizes[i % 6];
+            auto packet = smart_ptr::make_shared<std::vector<char>>();
+            packet->resize(n);
+            fill(reinterpret_cast<unsigned char *>(packet->data()), n, i);
+            std::vector<char> header(packet->begin(), packet->begin() + header_size);
+            std::vector<char> payload(packet->begin() + header_size, packet->end());
+            sink += consume(reinterpret_cast<const unsigned char *>(header.data()), header.size());
+            sink += consume(reinterpret_cast<const unsigned char *>(payload.data()), payload.size());
+        }
+        return sink;
+    }
+
+    unsigned long
+    run_bytes(std::size_t packets, bytes_pool &pool)
+    {
+        unsigned long sink = 0;
+        for (std::size_t i = 0; i < packets; ++i)
+        {
+            std::size_t n = packet_sizes[i % 6];
+            shared_bytes packet = shared_bytes::allocate(n, pool);
+            fill(packet.try_unique_mut(), n, i);
+            shared_bytes header = packet.slice(0, header_size);
+            shared_bytes payload = packet.slice(header_size);
+            packet.reset();
+            sink += consume(header.data(), header.size());
+            sink += consume(payload.data(), payload.size());
+        }
+        return sink;
+    }
+
+    template<typename F>
+    void
+    report(const char *name, std::size_t packets, unsigned long expected, F f)
+    {
+        long allocs = g_allocs;
+        auto begin = clock_type::now();
+        unsigned long sink = f();
+        double ns = std::chrono::duration<double, std::nano>(clock_type::now() - begin).count();
+        if (sink != expected)
+            std::exit(EXIT_FAILURE);
+        std::printf("%-40s %10.1f %12.2f\n", name, ns / double(packets),
+            double(g_allocs - allocs) / double(packets));
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t packets = 2000000;
+    if (argc > 1)
+        packets = std::strtoul(argv[1], nullptr, 10);
+
+    for (std::size_t i = 0; i < sizeof g_wire; ++i)
+        g_wire[i] = static_cast<unsigned char>(i * 131);
+    unsigned long expected = run_vector(packets); // also warms the allocator up
+    bytes_pool pool;
+    bytes_pool no_cache{ 0 };
+
+    std::printf("%-40s %10s %12s\n", "receive, split, release", "ns/packet", "allocs/packet");
+    report("shared_ptr<vector<char>> + copies", packets, expected, [&] { return run_vector(packets); });
+    report("shared_bytes::slice, no caching", packets, expected, [&] { return run_bytes(packets, no_cache); });
+    report("shared_bytes::slice, bytes_pool", packets, expected, [&] { return run_bytes(packets, pool); });
+
+    smart_ptr::pool_stats s = pool.stats();
+    std::printf("\nbytes_pool hit rate %.4f\n", s.hit_rate());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,245 @@
+// benchmark of sized deallocation through the smart pointer factories
+
+/**
+ * Installs a small size-class allocator as the global operator new and
+ *  delete, modelled on tcmalloc: blocks of up to 1 KiB come from per-class
+ *  free lists carved out of 8 KiB pages. An unsized delete has to find
+ *  the size class of the block through a two-level page map, as tcmalloc
+ *  does; a sized delete computes it from the size.
+ *
+ * For each construction path the benchmark reports how many frees reach
+ *  the allocator with a size, then times the path with the sizes used and
+ *  with them ignored, which forces the page map lookup, taking the best
+ *  of a few alternating runs. A pool of live objects is kept so that the
+ *  page map is not all in cache.
+ *
+ * Needs C++14 for sized operator delete, see the Makefile.
+ *
+ * Usage: sized_delete_bench.out [iterations]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "../smart_ptr.hpp"
+
+#if !defined(__cpp_sized_deallocation)
+#error "sized_delete_bench needs sized deallocation, build it with -std=c++14 or later"
+#endif
+
+using smart_ptr::shared_ptr;
+using smart_ptr::unique_ptr;
+using smart_ptr::make_shared;
+using smart_ptr::make_unique;
+using smart_ptr::make_unique_aligned;
+
+// Toy size-class allocator
+
+namespace
+{
+
+    const std::size_t class_step = 16;
+    const std::size_t max_small = 1024;
+    const std::size_t span_bytes = std::size_t{ 1 } << 13;
+    const int span_shift = 13;
+    const std::size_t region_bytes = std::size_t{ 1 } << 30;
+
+    struct free_block
+    {
+        free_block *next;
+    };
+
+    free_block *g_free[max_small / class_step + 1];
+    char *g_region = nullptr; // all small blocks live in one reserved region, span-aligned
+    char *g_region_top = nullptr;
+
+    // page map: span index -> size class, split in two levels as a real
+    // allocator covering the whole address space would be
+    const std::size_t leaf_bits = 8;
+    unsigned char *g_page_map[(region_bytes >> span_shift) >> leaf_bits];
+
+    bool g_use_size = true;
+    long g_sized_frees = 0;
+    long g_unsized_frees = 0;
+
+    std::size_t
+    size_class(std::size_t n)
+    {
+        return (n + class_step - 1) / class_step;
+    }
+
+    void
+    carve_span(std::size_t cls)
+    {
+        if (!g_region)
+        {
+            char *raw = static_cast<char *>(std::malloc(region_bytes + span_bytes));
+            g_region = reinterpret_cast<char *>(
+                (reinterpret_cast<std::uintptr_t>(raw) + span_bytes - 1) & ~std::uintptr_t(span_bytes - 1));
+            g_region_top = g_region;
+        }
+        char *span = g_region_top;
+        g_region_top += span_bytes;
+        std::size_t index = std::size_t(span - g_region) >> span_shift;
+        unsigned char *&leaf = g_page_map[index >> leaf_bits];
+        if (!leaf)
+            leaf = static_cast<unsigned char *>(std::calloc(std::size_t{ 1 } << leaf_bits, 1));
+        leaf[index & ((std::size_t{ 1 } << leaf_bits) - 1)] = static_cast<unsigned char>(cls);
+        std::size_t bytes = cls * class_step;
+        for (char *p = span; p + bytes <= span + span_bytes; p += bytes)
+        {
+            free_block *b = reinterpret_cast<free_block *>(p);
+            b->next = g_free[cls];
+            g_free[cls] = b;
+        }
+    }
+
+    bool
+    is_small(void *p)
+    {
+        return g_region && p >= g_region && p < g_region_top;
+    }
+
+    void *
+    toy_alloc(std::size_t n)
+    {
+        if (n == 0)
+            n = 1;
+        if (n > max_small)
+        {
+            if (void *p = std::malloc(n))
+                return p;
+            throw std::bad_alloc{};
+        }
+        std::size_t cls = size_class(n);
+        if (!g_free[cls])
+            carve_span(cls);
+        free_block *b = g_free[cls];
+        g_free[cls] = b->next;
+        return b;
+    }
+
+    void
+    toy_free(void *p, std::size_t cls)
+    {
+        free_block *b = static_cast<free_block *>(p);
+        b->next = g_free[cls];
+        g_free[cls] = b;
+    }
+
+    void
+    toy_free_unsized(void *p)
+    {
+        if (!p)
+            return;
+        ++g_unsized_frees;
+        if (!is_small(p))
+        {
+            std::free(p);
+            return;
+        }
+        std::size_t index = std::size_t(static_cast<char *>(p) - g_region) >> span_shift;
+        toy_free(p, g_page_map[index >> leaf_bits][index & ((std::size_t{ 1 } << leaf_bits) - 1)]);
+    }
+
+    void
+    toy_free_sized(void *p, std::size_t n)
+    {
+        if (!p)
+            return;
+        if (!g_use_size)
+        {
+            toy_free_unsized(p);
+            return;
+        }
+        ++g_sized_frees;
+        if (n > max_small)
+            std::free(p);
+        else
+            toy_free(p, size_class(n ? n : 1));
+    }
+
+} // namespace
+
+void *operator new(std::size_t n) { return toy_alloc(n); }
+void *operator new[](std::size_t n) { return toy_alloc(n); }
+void operator delete(void *p) noexcept { toy_free_unsized(p); }
+void operator delete[](void *p) noexcept { toy_free_unsized(p); }
+void operator delete(void *p, std::size_t n) noexcept { toy_free_sized(p, n); }
+void operator delete[](void *p, std::size_t n) noexcept { toy_free_sized(p, n); }
+
+namespace
+{
+
+    struct widget
+    {
+        long a;
+        long b;
+        char payload[40];
+    };
+
+    const std::size_t live_objects = 1 << 16;
+
+    /// Keeps live_objects results of make() alive, replacing a random one
+    /// per iteration, and returns ns per iteration
+    template<typename P, typename Make>
+    double
+    churn(std::size_t iterations, Make make)
+    {
+        std::mt19937 rng{ 7 };
+        std::vector<P> live(live_objects);
+        for (auto &p : live)
+            p = make();
+        auto begin = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            live[rng() % live_objects] = make();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - begin).count() / double(iterations);
+    }
+
+    template<typename P, typename Make>
+    void
+    report(const char *path, std::size_t iterations, Make make)
+    {
+        long sized = g_sized_frees, unsized = g_unsized_frees;
+        {
+            P p = make();
+        }
+        long s = g_sized_frees - sized, u = g_unsized_frees - unsized;
+
+        double with_size = 1e300, without_size = 1e300;
+        for (int run = 0; run < 3; ++run)
+        {
+            g_use_size = true;
+            with_size = std::min(with_size, churn<P>(iterations, make));
+            g_use_size = false;
+            without_size = std::min(without_size, churn<P>(iterations, make));
+        }
+        g_use_size = true;
+        std::printf("%-36s %2ld sized %2ld unsized %10.2f %10.2f\n", path, s, u, with_size, without_size);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t iterations = 2000000;
+    if (argc > 1)
+        iterations = std::strtoul(argv[1], nullptr, 10);
+
+    std::printf("%-36s %-20s %10s %10s\n", "path", "frees", "sized ns", "unsized ns");
+    report<shared_ptr<widget>>("make_shared<T>()", iterations, [] { return make_shared<widget>(); });
+    report<shared_ptr<widget>>("shared_ptr<T>(new T)", iterations, [] { return shared_ptr<widget>(new widget{}); });
+    report<shared_ptr<float[]>>("make_shared<T[]>(64)", iterations, [] { return make_shared<float[]>(64); });
+    report<unique_ptr<float[]>>("make_unique<T[]>(64)", iterations, [] { return make_unique<float[]>(64); });
+    report<unique_ptr<float[], smart_ptr::aligned_delete<float[]>>>("make_unique_aligned<T[]>(64, 16)", iterations,
+        [] { return make_unique_aligned<float[]>(64, 16); });
+    return 0;
+}
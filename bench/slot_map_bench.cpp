@@ -0,0 +1,123 @@
+// benchmark of slot_map handles against weak_ptr references
+
+/**
+ * An entity system with non-owning references between entities, once as
+ *  shared_ptr-owned entities referenced by weak_ptrs and once as a
+ *  slot_map referenced by handles. A tenth of the entities are destroyed
+ *  before measuring, so some references are stale.
+ *
+ * Reports per reference the cost of resolving it (weak_ptr::lock against
+ *  slot_map::get, in shuffled order) and per entity the cost of a system
+ *  update that walks every entity, along with the size of a reference.
+ *
+ * Usage: slot_map_bench.out [entities]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "../include/slot_map.hpp"
+#include "../include/weak_ptr.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::slot_map;
+
+namespace
+{
+
+    using clock_type = std::chrono::steady_clock;
+
+    struct entity
+    {
+        float x, y, vx, vy;
+    };
+
+    template<typename F>
+    double
+    ns_per(std::size_t n, F f)
+    {
+        double best = 1e300;
+        for (int run = 0; run < 5; ++run)
+        {
+            auto begin = clock_type::now();
+            f();
+            best = std::min(best, std::chrono::duration<double, std::nano>(clock_type::now() - begin).count());
+        }
+        return best / double(n);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t n = 1000000;
+    if (argc > 1)
+        n = std::strtoul(argv[1], nullptr, 10);
+
+    std::mt19937 rng{ 42 };
+    std::vector<std::size_t> order(n);
+    for (std::size_t i = 0; i < n; ++i)
+        order[i] = i;
+    std::shuffle(order.begin(), order.end(), rng);
+    std::size_t destroyed = n / 10;
+
+    // shared_ptr entities, weak_ptr references
+    std::vector<shared_ptr<entity>> owners;
+    std::vector<weak_ptr<entity>> weak_refs;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        owners.push_back(smart_ptr::make_shared<entity>(entity{ float(i), 0, 1, 1 }));
+        weak_refs.push_back(owners.back());
+    }
+    for (std::size_t i = 0; i < destroyed; ++i)
+        owners[order[i]].reset();
+    owners.erase(std::remove(owners.begin(), owners.end(), nullptr), owners.end());
+
+    // slot_map entities, handle references
+    slot_map<entity> entities;
+    std::vector<slot_map<entity>::handle_type> handles;
+    for (std::size_t i = 0; i < n; ++i)
+        handles.push_back(entities.insert(entity{ float(i), 0, 1, 1 }));
+    for (std::size_t i = 0; i < destroyed; ++i)
+        entities.erase(handles[order[i]]);
+
+    std::shuffle(order.begin(), order.end(), rng);
+    float sink = 0;
+
+    double lock_ns = ns_per(n, [&] {
+        for (std::size_t i : order)
+            if (shared_ptr<entity> e = weak_refs[i].lock())
+                sink += e->x;
+    });
+    double get_ns = ns_per(n, [&] {
+        for (std::size_t i : order)
+            if (const entity *e = entities.get(handles[i]))
+                sink += e->x;
+    });
+
+    double owners_ns = ns_per(owners.size(), [&] {
+        for (const auto &e : owners)
+        {
+            e->x += e->vx;
+            e->y += e->vy;
+        }
+    });
+    double dense_ns = ns_per(entities.size(), [&] {
+        for (auto &e : entities)
+        {
+            e.x += e.vx;
+            e.y += e.vy;
+        }
+    });
+
+    std::printf("%zu entities, %zu destroyed\n\n", n, destroyed);
+    std::printf("%-36s %10s %10s %10s\n", "", "resolve ns", "update ns", "ref bytes");
+    std::printf("%-36s %10.2f %10.2f %10zu\n", "shared_ptr + weak_ptr::lock", lock_ns, owners_ns, sizeof(weak_ptr<entity>));
+    std::printf("%-36s %10.2f %10.2f %10zu\n", "slot_map + handle", get_ns, dense_ns, sizeof(handles[0]));
+    return sink != 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,92 @@
+// benchmark of strong_ptr against shared_ptr
+
+/**
+ * Compares make_strong with make_shared, single threaded: creating and
+ *  releasing an object, copying and dropping a pointer to it, then the
+ *  explicit conversions between the two, which allocate. Also prints the
+ *  sizes of the headers.
+ *
+ * Usage: strong_ptr_bench.out [iterations]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+
+#include "../include/strong_ptr.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::strong_ptr;
+
+namespace
+{
+
+    using clock_type = std::chrono::steady_clock;
+
+    struct message
+    {
+        long id;
+        long payload[3];
+    };
+
+    template<typename F>
+    double
+    ns_per(std::size_t n, F f)
+    {
+        double best = 1e300;
+        for (int run = 0; run < 5; ++run)
+        {
+            auto begin = clock_type::now();
+            for (std::size_t i = 0; i < n; ++i)
+                f(i);
+            best = std::min(best, std::chrono::duration<double, std::nano>(clock_type::now() - begin).count());
+        }
+        return best / double(n);
+    }
+
+    template<typename Make>
+    void
+    report(const char *name, std::size_t n, Make make)
+    {
+        double create = ns_per(n, [&](std::size_t i) {
+            auto p = make(long(i));
+            asm volatile("" : : "r"(p.get()) : "memory");
+        });
+        auto p = make(0L);
+        double copy = ns_per(n, [&](std::size_t) {
+            auto c = p;
+            asm volatile("" : : "r"(c.get()) : "memory");
+        });
+        std::printf("%-28s %12.2f %12.2f\n", name, create, copy);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t n = 2000000;
+    if (argc > 1)
+        n = std::strtoul(argv[1], nullptr, 10);
+
+    std::printf("%-28s %12s %12s\n", "ns per operation", "create/drop", "copy/drop");
+    report("make_shared", n, [](long id) { return smart_ptr::make_shared<message>(message{ id, { 0, 0, 0 } }); });
+    report("make_strong", n, [](long id) { return smart_ptr::make_strong<message>(message{ id, { 0, 0, 0 } }); });
+
+    auto strong = smart_ptr::make_strong<message>(message{ 0, { 0, 0, 0 } });
+    auto shared = smart_ptr::make_shared<message>(message{ 0, { 0, 0, 0 } });
+    double to_shared = ns_per(n, [&](std::size_t) {
+        shared_ptr<message> s = smart_ptr::to_shared_ptr(strong);
+        asm volatile("" : : "r"(s.get()) : "memory");
+    });
+    double to_strong = ns_per(n, [&](std::size_t) {
+        strong_ptr<message> s = smart_ptr::to_strong_ptr(shared);
+        asm volatile("" : : "r"(s.get()) : "memory");
+    });
+    std::printf("\n%-28s %12.2f\n%-28s %12.2f\n", "to_shared_ptr + drop", to_shared, "to_strong_ptr + drop", to_strong);
+
+    std::printf("\nheader bytes: strong_ptr %zu, make_shared control block without the object %zu\n",
+        sizeof(smart_ptr::detail::strong_header),
+        sizeof(smart_ptr::detail::control_block_inplace<message>) - sizeof(message));
+    return EXIT_SUCCESS;
+}
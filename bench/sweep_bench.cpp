@@ -0,0 +1,117 @@
+// benchmark of sweep_expired and expired_batch
+
+/**
+ * Fills an observer list with weak_ptrs to objects whose control blocks
+ *  are scattered over the heap, lets half of the objects die, then
+ *  compares:
+ *  - counting the expired entries with a plain loop and with expired_batch
+ *  - removing them with erase/remove_if and with sweep_expired, the
+ *    latter also in slices of a fixed budget, reporting the worst slice
+ *
+ * Usage: sweep_bench.out [entries]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "../smart_ptr.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::make_shared;
+using smart_ptr::expired_batch;
+using smart_ptr::sweep_expired;
+
+namespace
+{
+
+    struct observer
+    {
+        long id;
+        char state[48];
+    };
+
+    using clock_type = std::chrono::steady_clock;
+
+    double
+    ms_since(clock_type::time_point begin)
+    {
+        return std::chrono::duration<double, std::milli>(clock_type::now() - begin).count();
+    }
+
+    // half of the owners die, the list keeps a weak_ptr to each of them
+    std::vector<weak_ptr<observer>>
+    make_list(std::size_t n, std::vector<shared_ptr<observer>> &alive, std::mt19937_64 &rng)
+    {
+        std::vector<shared_ptr<observer>> owners;
+        for (std::size_t i = 0; i < n; ++i)
+            owners.push_back(make_shared<observer>());
+        std::shuffle(owners.begin(), owners.end(), rng); // scatter the control blocks
+        std::vector<weak_ptr<observer>> list(owners.begin(), owners.end());
+        alive.assign(owners.begin(), owners.begin() + n / 2);
+        return list;
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t n = 1000000;
+    if (argc > 1)
+        n = std::strtoul(argv[1], nullptr, 10);
+
+    std::mt19937_64 rng{ 42 };
+    std::vector<shared_ptr<observer>> alive;
+    std::vector<weak_ptr<observer>> list = make_list(n, alive, rng);
+
+    auto begin = clock_type::now();
+    std::size_t plain = 0;
+    for (const auto &wp : list)
+        plain += wp.expired();
+    double plain_ms = ms_since(begin);
+
+    std::vector<char> flags(list.size());
+    begin = clock_type::now();
+    expired_batch(list.begin(), list.end(), flags.begin());
+    std::size_t batched = std::count(flags.begin(), flags.end(), 1);
+    double batch_ms = ms_since(begin);
+
+    std::printf("count expired:   plain loop %8.2f ms, expired_batch %8.2f ms\n", plain_ms, batch_ms);
+
+    std::vector<weak_ptr<observer>> copy = list;
+    begin = clock_type::now();
+    copy.erase(std::remove_if(copy.begin(), copy.end(),
+                   [](const weak_ptr<observer> &wp) { return wp.expired(); }),
+        copy.end());
+    double remove_ms = ms_since(begin);
+
+    copy = list;
+    std::size_t cursor = 0;
+    begin = clock_type::now();
+    std::size_t removed = sweep_expired(copy, copy.size(), cursor);
+    double sweep_ms = ms_since(begin);
+
+    std::printf("remove expired:  remove_if  %8.2f ms, sweep_expired %8.2f ms\n", remove_ms, sweep_ms);
+
+    const std::size_t budget = 4096;
+    copy = list;
+    cursor = 0;
+    std::size_t slices = 0, sliced = 0;
+    double worst_ms = 0;
+    for (std::size_t examined = 0; examined < list.size(); examined += budget, ++slices)
+    {
+        begin = clock_type::now();
+        sliced += sweep_expired(copy, budget, cursor);
+        worst_ms = std::max(worst_ms, ms_since(begin));
+    }
+    std::printf("sliced sweep:    %zu slices of %zu, worst slice %.3f ms\n", slices, budget, worst_ms);
+
+    bool ok = plain == batched && removed == plain && sliced == plain && copy.size() == alive.size();
+    if (!ok)
+        std::printf("mismatch: %zu %zu %zu %zu\n", plain, batched, removed, sliced);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+// benchmark of weak_value_map against a mutex-protected map
+
+/**
+ * Several threads intern the same set of expensive objects at once. The
+ *  naive cache (one mutex around an unordered_map of weak_ptrs, factory
+ *  called outside the lock) lets every thread that misses construct its
+ *  own copy; weak_value_map constructs each key once. Reports the number
+ *  of factory calls and the time per lookup, then the lookup cost once
+ *  every object is cached.
+ *
+ * Usage: weak_value_map_bench.out [threads] [keys]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#include "../smart_ptr.hpp"
+
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::make_shared;
+using smart_ptr::weak_value_map;
+
+namespace
+{
+
+    struct compiled
+    {
+        long key;
+        long checksum;
+    };
+
+    std::atomic<long> g_constructions{ 0 };
+
+    shared_ptr<compiled>
+    compile(long key)
+    {
+        ++g_constructions;
+        long sum = 0;
+        for (long i = 0; i < 20000; ++i) // stands in for parsing a schema or a regex
+            sum += (i * key) ^ (sum >> 3);
+        return make_shared<compiled>(key, sum);
+    }
+
+    class naive_cache
+    {
+    public:
+        shared_ptr<compiled>
+        get_or_create(long key)
+        {
+            {
+                std::lock_guard<std::mutex> lock{ _mutex };
+                auto it = _map.find(key);
+                if (it != _map.end())
+                    if (auto sp = it->second.lock())
+                        return sp;
+            }
+            auto sp = compile(key);
+            std::lock_guard<std::mutex> lock{ _mutex };
+            _map[key] = sp;
+            return sp;
+        }
+
+    private:
+        std::mutex _mutex;
+        std::unordered_map<long, weak_ptr<compiled>> _map;
+    };
+
+    template<typename Lookup>
+    double
+    run(unsigned threads, long keys, int rounds, Lookup lookup)
+    {
+        std::atomic<unsigned> waiting{ threads };
+        std::atomic<unsigned> running{ threads };
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t)
+            workers.emplace_back([&] {
+                std::vector<shared_ptr<compiled>> held;
+                --waiting;
+                while (waiting.load() != 0)
+                    std::this_thread::yield();
+                for (int r = 0; r < rounds; ++r)
+                    for (long k = 0; k < keys; ++k)
+                        held.push_back(lookup(k));
+                // keep the objects alive until every thread is done, so
+                // no key expires and gets legitimately rebuilt
+                --running;
+                while (running.load() != 0)
+                    std::this_thread::yield();
+            });
+        for (auto &w : workers)
+            w.join();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - begin).count()
+            / double(threads * keys * rounds);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    if (threads < 4)
+        threads = 4;
+    long keys = 256;
+    if (argc > 1)
+        threads = static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10));
+    if (argc > 2)
+        keys = std::strtol(argv[2], nullptr, 10);
+
+    {
+        naive_cache cache;
+        g_constructions = 0;
+        double ns = run(threads, keys, 1, [&](long k) { return cache.get_or_create(k); });
+        std::printf("mutex + map     cold: %9.1f ns/lookup, %ld constructions for %ld keys\n",
+            ns, g_constructions.load(), keys);
+    }
+    {
+        weak_value_map<long, compiled> cache;
+        g_constructions = 0;
+        double ns = run(threads, keys, 1, [&](long k) {
+            return cache.get_or_create(k, [k] { return compile(k); });
+        });
+        std::printf("weak_value_map  cold: %9.1f ns/lookup, %ld constructions for %ld keys\n",
+            ns, g_constructions.load(), keys);
+
+        std::vector<shared_ptr<compiled>> pinned;
+        for (long k = 0; k < keys; ++k)
+            pinned.push_back(cache.get_or_create(k, [k] { return compile(k); }));
+        ns = run(threads, keys, 20, [&](long k) {
+            return cache.get_or_create(k, [k] { return compile(k); });
+        });
+        std::printf("weak_value_map  warm: %9.1f ns/lookup\n", ns);
+
+        pinned.clear();
+        std::printf("expired entries purged: %zu\n", cache.purge());
+    }
+    return 0;
+}
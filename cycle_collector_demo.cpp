@@ -0,0 +1,139 @@
+// demo of the cycle collector
+
+/**
+ *  Builds parent/child and ring shaped cycles that plain reference
+ *  counting can never reclaim, then collects them with collect_cycles().
+ */
+
+#include <iostream>
+#include <cassert>
+#include <vector>
+#include <thread>
+#include <new>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::make_cycle_collectable;
+using smart_ptr::collect_cycles;
+using smart_ptr::cycle_candidates;
+using smart_ptr::cycle_tracer;
+
+static int alive = 0;
+static int traces_before_failure = -1; // simulates running out of memory while edges are reported
+
+struct Node
+{
+    explicit Node(int id) : id(id) { ++alive; }
+    ~Node() { --alive; std::cout << "  Node " << id << " destroyed\n"; }
+
+    void trace(cycle_tracer& t) // reports the outgoing edges to the collector
+    {
+        if (traces_before_failure >= 0 && traces_before_failure-- == 0)
+            throw std::bad_alloc{};
+        t(next);
+        for (auto& c : children) t(c);
+    }
+
+    int id;
+    shared_ptr<Node> next;
+    std::vector<shared_ptr<Node>> children;
+};
+
+int main()
+{
+    std::cout << "===============cycle collector demo===============" << std::endl;
+
+    std::cout << "\nParent/child cycle demo\n";
+    {
+        auto parent = make_cycle_collectable<Node>(1);
+        auto child = make_cycle_collectable<Node>(2);
+        parent->children.push_back(child);
+        child->next = parent; // back edge to the parent keeps both alive
+    }
+    std::cout << "alive after scope: " << alive << ", candidates: " << cycle_candidates() << '\n';
+    std::cout << "collected: " << collect_cycles() << '\n';
+    std::cout << "alive after collect_cycles: " << alive << '\n';
+    assert(alive == 0);
+
+    std::cout << "\nRing with an external reference demo\n";
+    {
+        shared_ptr<Node> keep;
+        weak_ptr<Node> watch;
+        {
+            auto a = make_cycle_collectable<Node>(3);
+            auto b = make_cycle_collectable<Node>(4);
+            auto c = make_cycle_collectable<Node>(5);
+            a->next = b; b->next = c; c->next = a;
+            keep = b; // the ring is still reachable through keep
+            watch = c;
+        }
+        std::cout << "collected while referenced: " << collect_cycles() << '\n';
+        assert(alive == 3);
+        keep.reset();
+        std::cout << "collected after release: " << collect_cycles() << '\n';
+        std::cout << "weak_ptr to a collected node expired: " << watch.expired() << '\n';
+    }
+    assert(alive == 0);
+
+    std::cout << "\nBounded collection demo\n";
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            auto a = make_cycle_collectable<Node>(10 + 2 * i);
+            auto b = make_cycle_collectable<Node>(11 + 2 * i);
+            a->next = b; b->next = a;
+        }
+        std::cout << "candidates: " << cycle_candidates() << '\n';
+        std::cout << "collected with a budget of 2 candidates: " << collect_cycles(2) << '\n';
+        std::cout << "collected with no budget: " << collect_cycles() << '\n';
+    }
+    assert(alive == 0);
+
+    std::cout << "\nInterrupted collection demo\n";
+    {
+        {
+            auto a = make_cycle_collectable<Node>(20);
+            auto b = make_cycle_collectable<Node>(21);
+            auto c = make_cycle_collectable<Node>(22);
+            a->next = b; b->next = c; c->next = a;
+        }
+        std::size_t candidates = cycle_candidates();
+        traces_before_failure = 4; // fails while the ring is being scanned
+        try
+        {
+            collect_cycles();
+        }
+        catch (const std::bad_alloc&)
+        {
+            std::cout << "collect_cycles threw bad_alloc\n";
+        }
+        traces_before_failure = -1;
+        std::cout << "alive: " << alive << ", candidates kept: " << (cycle_candidates() == candidates) << '\n';
+        assert(alive == 3 && cycle_candidates() == candidates);
+        std::cout << "collected on retry: " << collect_cycles() << '\n';
+    }
+    assert(alive == 0);
+
+    std::cout << "\nConcurrent release demo\n";
+    {
+        struct Leaf
+        {
+            void trace(cycle_tracer&) {}
+        };
+        for (int round = 0; round < 10000; ++round)
+        {
+            auto a = make_cycle_collectable<Leaf>();
+            auto b = a;
+            // the first reset records a candidate while the other may free the block
+            std::thread t{ [&a] { a.reset(); } };
+            b.reset();
+            t.join();
+        }
+        std::cout << "candidates left by released copies: " << cycle_candidates() << '\n';
+        std::cout << "collected: " << collect_cycles() << '\n';
+        assert(cycle_candidates() == 0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+// aligned allocation helpers
+
+/**
+ * Allocation functions that honour an alignment larger than the one plain
+ *  operator new guarantees. With C++17 aligned new they forward to
+ *  operator new(size, align_val_t), before C++17 they over-allocate and
+ *  keep the address returned by operator new right in front of the
+ *  aligned block. Alignments the default operator new already provides
+ *  cost nothing extra.
+ *
+ * The control blocks that embed the managed object allocate themselves
+ *  through these, so make_shared and the other fused factories place an
+ *  over-aligned T on its boundary even in C++11.
+ *
+ * Deallocation always knows the size of the block and passes it to sized
+ *  operator delete when the compiler provides it (C++14 and later).
+ */
+
+#ifndef ALIGNED_NEW_HPP
+#define ALIGNED_NEW_HPP 1
+
+#include <cassert> // assert
+#include <cstddef> // size_t, max_align_t
+#include <cstdint> // uintptr_t
+#include <new> // operator new, operator delete, align_val_t
+#include <stdexcept> // invalid_argument
+#include <type_traits> // integral_constant, true_type, remove_extent
+
+namespace smart_ptr
+{
+
+    namespace detail
+    {
+
+        /// Alignment guaranteed by the plain operator new
+#if defined(__STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        constexpr std::size_t default_new_alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+#else
+        constexpr std::size_t default_new_alignment = alignof(std::max_align_t);
+#endif
+
+        /// Checks whether new T, or new U[n] for T = U[], places the
+        ///     objects on their alignment boundary: always with C++17
+        ///     aligned new, before only up to default_new_alignment or
+        ///     when the class has its own allocation function, as
+        ///     aligned_new gives it
+        template<typename T, typename = void>
+        struct is_new_aligned
+            : std::integral_constant<bool,
+#if defined(__cpp_aligned_new)
+                true
+#else
+                alignof(typename std::remove_extent<T>::type) <= default_new_alignment
+#endif
+            >
+        {
+        };
+
+        template<typename T>
+        struct is_new_aligned<T, decltype(void(T::operator new(std::size_t{})))> : std::true_type
+        {
+        };
+
+        template<typename T>
+        struct is_new_aligned<T[], decltype(void(T::operator new[](std::size_t{})))> : std::true_type
+        {
+        };
+
+        /// Checks an alignment given at runtime to a public factory, which
+        ///     rounds 0 up to the type's alignment like any smaller value
+        /// Throws std::invalid_argument unless it is 0 or a power of two:
+        ///     the offsets derived from it would be wrong.
+        inline void
+        check_alignment(std::size_t align)
+        {
+            if (align & (align - 1))
+                throw std::invalid_argument{ "alignment is not a power of two" };
+        }
+
+        /// Allocates size bytes aligned to align, a power of two
+        inline void *
+        allocate_aligned(std::size_t size, std::size_t align)
+        {
+            assert(align && !(align & (align - 1)) && "alignment must be a power of two");
+            if (align <= default_new_alignment)
+                return ::operator new(size);
+#if defined(__cpp_aligned_new)
+            return ::operator new(size, std::align_val_t(align));
+#else
+            // align > default_new_alignment >= sizeof(void *), so rounding
+            // raw + align down leaves room for the raw address in front
+            if (size > std::size_t(-1) - align)
+                throw std::bad_alloc{};
+            void *raw = ::operator new(size + align);
+            std::uintptr_t p = (reinterpret_cast<std::uintptr_t>(raw) + align) & ~std::uintptr_t(align - 1);
+            reinterpret_cast<void **>(p)[-1] = raw;
+            return reinterpret_cast<void *>(p);
+#endif
+        }
+
+        /// Frees a block of size bytes obtained from operator new(size)
+        /// The size is passed on to sized operator delete when available,
+        ///     which lets size-class allocators skip looking it up.
+        inline void
+        deallocate(void *p, std::size_t size) noexcept
+        {
+#if defined(__cpp_sized_deallocation)
+            ::operator delete(p, size);
+#else
+            (void)size;
+            ::operator delete(p);
+#endif
+        }
+
+        /// Frees a block obtained from allocate_aligned(size, align)
+        inline void
+        deallocate_aligned(void *p, std::size_t size, std::size_t align) noexcept
+        {
+            if (align <= default_new_alignment)
+            {
+                deallocate(p, size);
+                return;
+            }
+#if defined(__cpp_aligned_new) && defined(__cpp_sized_deallocation)
+            ::operator delete(p, size, std::align_val_t(align));
+#elif defined(__cpp_aligned_new)
+            (void)size;
+            ::operator delete(p, std::align_val_t(align));
+#else
+            deallocate(static_cast<void **>(p)[-1], size + align);
+#endif
+        }
+
+        // header in front of the elements of a make_unique_aligned array
+        // Lets a stateless deleter find the element count and the start of
+        // the allocation.
+
+        struct aligned_array_header
+        {
+            std::size_t size;
+            std::size_t align;
+        };
+
+        /// Offset of the elements from the start of the allocation
+        inline std::size_t
+        aligned_array_offset(std::size_t align) noexcept
+        {
+            return (sizeof(aligned_array_header) + align - 1) & ~(align - 1);
+        }
+
+        // base giving a class allocation functions that honour Align
+        // new and delete of the derived class go through it, delete this
+        // included, as long as the destructor is virtual.
+
+        template<std::size_t Align>
+        struct aligned_new
+        {
+            static void *
+            operator new(std::size_t size)
+            {
+                return allocate_aligned(size, Align);
+            }
+
+            static void
+            operator delete(void *p, std::size_t size) noexcept
+            {
+                deallocate_aligned(p, size, Align);
+            }
+        };
+
+    } // namespace detail
+
+} // namespace smart_ptr
+
+#endif
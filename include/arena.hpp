@@ -0,0 +1,228 @@
+// arena implementation
+
+/**
+ * arena is a monotonic allocator for request-scoped shared objects.
+ *  make_shared_in(a, args...) places the object and its control block in
+ *  the arena. Releasing the last shared_ptr still runs the destructor of
+ *  the object, but no memory is freed: releases only touch the counts,
+ *  and everything is given back at once by reset() or ~arena().
+ *
+ * Every shared_ptr and weak_ptr into the arena must be gone by then,
+ *  which reset() asserts in debug builds.
+ *
+ * Allocation is not thread-safe, an arena belongs to one request at a
+ *  time. The pointers it hands out may be copied and released from any
+ *  thread, as with make_shared.
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP 1
+
+#include <cassert> // assert
+#include <cstddef> // size_t, max_align_t
+#include <cstdint> // uintptr_t
+#include <new> // placement new, operator new
+#include <utility> // forward
+#include <type_traits> // aligned_storage
+
+#include "control_block.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    class arena;
+
+    namespace detail
+    {
+
+        // control block of make_shared_in
+        // Lives in an arena, so destroying it frees nothing.
+
+        class control_block_arena_base : public control_block_counted
+        {
+        public:
+            void *
+            get_deleter() noexcept override // make_shared_in has no deleter
+            {
+                return nullptr;
+            }
+
+        private:
+            friend class smart_ptr::arena;
+
+            void
+            destroy() noexcept override
+            {
+            }
+
+            control_block_arena_base *_next_in_arena = nullptr;
+        };
+
+        template<typename T>
+        class control_block_arena : public control_block_arena_base
+        {
+        public:
+            using element_type = T;
+
+            template<typename... Args>
+            explicit control_block_arena(Args &&...args)
+            {
+                ::new (static_cast<void *>(&_storage)) T{ std::forward<Args>(args)... };
+            }
+
+            T *
+            ptr() noexcept
+            {
+                return reinterpret_cast<T *>(&_storage);
+            }
+
+        private:
+            void
+            dispose() noexcept override
+            {
+                ptr()->~T();
+            }
+
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+        };
+
+    } // namespace detail
+
+    class arena
+    {
+    public:
+        /// Creates an arena that grabs memory in chunks of chunk_size bytes
+        explicit arena(std::size_t chunk_size = 64 * 1024) noexcept
+            :
+            _chunk_size{ chunk_size }
+        {
+        }
+
+        /// Frees every chunk
+        /// Precondition: nothing allocated from the arena is still referenced.
+        ~arena()
+        {
+            reset();
+            _free_chunks(_chunks);
+        }
+
+        arena(const arena &) = delete;
+        arena &operator=(const arena &) = delete;
+
+        /// Allocates n bytes aligned to align, freed only by reset()
+        void *
+        allocate(std::size_t n, std::size_t align)
+        {
+            std::uintptr_t p = (_cur + (align - 1)) & ~std::uintptr_t(align - 1);
+            if (!_chunks || p + n > _end)
+            {
+                _grow(n + align);
+                p = (_cur + (align - 1)) & ~std::uintptr_t(align - 1);
+            }
+            _cur = p + n;
+            _allocated += n;
+            return reinterpret_cast<void *>(p);
+        }
+
+        /// Gives back everything allocated so far, keeping the first chunk
+        ///     for the next request
+        /// Precondition: nothing allocated from the arena is still referenced.
+        void
+        reset() noexcept
+        {
+#ifndef NDEBUG
+            for (auto *cb = _blocks; cb; cb = cb->_next_in_arena)
+                assert(cb->expired() && cb->weak_use_count() == 0
+                    && "shared_ptr or weak_ptr outlives its arena");
+#endif
+            _blocks = nullptr;
+            if (_chunks)
+            {
+                // chunks are pushed in front, the first one is last in the list
+                chunk **first = &_chunks;
+                while ((*first)->next)
+                    first = &(*first)->next;
+                chunk *keep = *first;
+                *first = nullptr;
+                _free_chunks(_chunks);
+                _chunks = keep;
+                _cur = reinterpret_cast<std::uintptr_t>(keep + 1);
+                _end = reinterpret_cast<std::uintptr_t>(keep) + keep->size;
+            }
+            _allocated = 0;
+        }
+
+        /// Bytes handed out since the last reset
+        std::size_t
+        bytes_allocated() const noexcept
+        {
+            return _allocated;
+        }
+
+    private:
+        template<typename T, typename... Args>
+        friend shared_ptr<T> make_shared_in(arena &, Args &&...);
+
+        struct chunk
+        {
+            chunk *next;
+            std::size_t size;
+        };
+
+        void
+        _grow(std::size_t at_least)
+        {
+            std::size_t size = sizeof(chunk) + at_least;
+            if (size < _chunk_size)
+                size = _chunk_size;
+            chunk *c = static_cast<chunk *>(::operator new(size));
+            c->next = _chunks;
+            c->size = size;
+            _chunks = c;
+            _cur = reinterpret_cast<std::uintptr_t>(c + 1);
+            _end = reinterpret_cast<std::uintptr_t>(c) + size;
+        }
+
+        static void
+        _free_chunks(chunk *c) noexcept
+        {
+            while (c)
+            {
+                chunk *next = c->next;
+                detail::deallocate(static_cast<void *>(c), c->size);
+                c = next;
+            }
+        }
+
+        void
+        _track(detail::control_block_arena_base *cb) noexcept
+        {
+            cb->_next_in_arena = _blocks;
+            _blocks = cb;
+        }
+
+        std::size_t _chunk_size;
+        chunk *_chunks = nullptr;
+        std::uintptr_t _cur = 0;
+        std::uintptr_t _end = 0;
+        std::size_t _allocated = 0;
+        detail::control_block_arena_base *_blocks = nullptr;
+    };
+
+    /// Creates a shared_ptr to a new object allocated, together with its
+    ///     control block, from the arena a
+    template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_shared_in(arena &a, Args &&...args)
+    {
+        using block = detail::control_block_arena<T>;
+        void *mem = a.allocate(sizeof(block), alignof(block));
+        auto *cb = ::new (mem) block{ std::forward<Args>(args)... };
+        a._track(cb);
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+} // namespace smart_ptr
+
+#endif
@@ -3,11 +3,17 @@
 #ifndef CONTROL_BLOCK_HPP
 #define CONTROL_BLOCK_HPP 1
 
+#include <cstddef> // size_t
+#include <cstdint> // uintptr_t, uint64_t
+#include <new> // placement new, operator new, bad_array_new_length
 #include <memory> // allocator, addressof
 #include <atomic> // atomic
+#include <utility> // forward
+#include <type_traits> // aligned_storage, is_trivially_destructible, is_array, integral_constant
 
 #include "ptr.hpp"
 #include "default_delete.hpp"
+#include "aligned_new.hpp"
 
 namespace smart_ptr
 {
@@ -23,6 +29,7 @@ namespace smart_ptr
             virtual ~control_block_base(){};
 
             virtual void inc_ref() noexcept = 0;
+            virtual bool try_inc_ref() noexcept = 0; // inc_ref unless use_count is 0
             virtual void inc_wref() noexcept = 0;
             virtual void dec_ref() noexcept = 0;
             virtual void dec_wref() noexcept = 0;
@@ -35,40 +42,45 @@ namespace smart_ptr
             virtual void *get_deleter() noexcept = 0;
         };
 
-        // control block for reference counting of shared_ptr and weak_ptr
-
-        /**
- * NOT implemented: custom allocator support.
- * 
- * The allocator is intended to be used to allocate and deallocate
- *  internal shared_ptr details, not the object.
- */
+        // Owner-based hash of shared_ptr and weak_ptr
+        // Control blocks are heap objects whose low address bits are
+        // always zero, so the address is run through the murmur3 64-bit
+        // finalizer to spread entropy over every bit, as open addressing
+        // tables that mask the low bits need.
 
-        template<typename T, typename D = default_delete<T>>
-        class control_block : public control_block_base
+        inline std::size_t
+        owner_hash_of(const control_block_base *cb) noexcept
         {
-        public:
-            using element_type = T;
-            using deleter_type = D;
-
-            // Constructors
+            std::uint64_t h = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(cb));
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ull;
+            h ^= h >> 33;
+            return static_cast<std::size_t>(h);
+        }
+
+        // tag for the shared_ptr constructor that adopts a reference
+        // already counted in the control block
+
+        struct adopt_control_block_t
+        {
+        };
 
-            control_block(T *p) :
-                _impl{ p }
-            {
-            }
+        // tag for the factories that default-initialize instead of
+        // value-initializing, see make_shared_for_overwrite
 
-            control_block(T *p, D d) :
-                _impl{ p, d }
-            {
-            }
-
-            // Destructor
+        struct for_overwrite_t
+        {
+        };
 
-            ~control_block()
-            {
-            }
+        // reference counting shared by the concrete control blocks
+        // Derived classes only decide how the managed object and
+        // the control block itself are destroyed.
 
+        class control_block_counted : public control_block_base
+        {
+        public:
             // Modifiers
 
             void
@@ -77,6 +89,16 @@ namespace smart_ptr
                 ++_use_count;
             }
 
+            bool
+            try_inc_ref() noexcept override
+            {
+                long n = _use_count.load(std::memory_order_relaxed);
+                while (n != 0)
+                    if (_use_count.compare_exchange_weak(n, n + 1))
+                        return true;
+                return false;
+            }
+
             void
             inc_wref() noexcept override
             {
@@ -86,12 +108,9 @@ namespace smart_ptr
             void
             dec_ref() noexcept override
             {
-                auto _ptr = _impl._impl_ptr();
-                auto &_deleter = _impl._impl_deleter();
                 if (--_use_count == 0)
                 {
-                    if (_ptr)
-                        _deleter(_ptr); // destroy the object _ptr points to
+                    dispose(); // destroy the managed object
                     dec_wref();
                 }
             }
@@ -101,7 +120,7 @@ namespace smart_ptr
             {
                 if (--_weak_use_count == 0)
                 {
-                    delete this; // destroy control_block itself
+                    destroy(); // destroy control_block itself
                 }
             }
 
@@ -116,7 +135,10 @@ namespace smart_ptr
             bool
             unique() const noexcept override
             {
-                return _use_count == 1;
+                // acquire pairs with the release of the decrements, so the
+                // writes of the other owners happen before whatever the
+                // caller does to the object it now owns alone
+                return _use_count.load(std::memory_order_acquire) == 1;
             }
 
             long
@@ -131,6 +153,63 @@ namespace smart_ptr
                 return _use_count == 0;
             }
 
+        protected:
+            /// Destroys the managed object, called when use_count drops to 0
+            virtual void dispose() noexcept = 0;
+
+            /// Destroys the control block, called when weak_use_count drops to 0
+            virtual void destroy() noexcept = 0;
+
+            /// Restores the counts of a freshly created block, for blocks that
+            ///     are recycled instead of destroyed
+            void
+            revive() noexcept
+            {
+                _use_count.store(1, std::memory_order_relaxed);
+                _weak_use_count.store(1, std::memory_order_relaxed);
+            }
+
+        private:
+            std::atomic<long> _use_count{ 1 };
+            std::atomic<long> _weak_use_count{ 1 }; // Note: _weak_use_count = #weak_ptrs + (#shared_ptr > 0) ? 1 : 0
+        };
+
+        // control block for reference counting of shared_ptr and weak_ptr
+
+        /**
+ * NOT implemented: custom allocator support.
+ * 
+ * The allocator is intended to be used to allocate and deallocate
+ *  internal shared_ptr details, not the object.
+ */
+
+        template<typename T, typename D = default_delete<T>>
+        class control_block : public control_block_counted
+        {
+        public:
+            using element_type = T;
+            using deleter_type = D;
+
+            // Constructors
+
+            control_block(T *p) :
+                _impl{ p }
+            {
+            }
+
+            control_block(T *p, D d) :
+                _impl{ p, d }
+            {
+            }
+
+            // Destructor
+
+            ~control_block()
+            {
+            }
+
+            // Observers
+
             void *
             get_deleter() noexcept override // Type erasure for storing deleter
             {
@@ -138,11 +217,257 @@ namespace smart_ptr
             }
 
         private:
-            std::atomic<long> _use_count{ 1 };
-            std::atomic<long> _weak_use_count{ 1 }; // Note: _weak_use_count = #weak_ptrs + (#shared_ptr > 0) ? 1 : 0
+            void
+            dispose() noexcept override
+            {
+                auto _ptr = _impl._impl_ptr();
+                auto &_deleter = _impl._impl_deleter();
+                if (_ptr != nullptr)
+                    _deleter(_ptr); // destroy the object _ptr points to
+            }
+
+            void
+            destroy() noexcept override
+            {
+                delete this;
+            }
+
             Ptr<T, D> _impl;
         };
 
+        // control block used by make_shared
+        // The object lives inside the control block, so creating the
+        // shared_ptr costs a single allocation. There is no deleter.
+
+        template<typename T>
+        class control_block_inplace : public control_block_counted, public aligned_new<alignof(T)>
+        {
+        public:
+            using element_type = T;
+
+            // Constructors
+
+            template<typename... Args>
+            explicit control_block_inplace(Args &&...args)
+            {
+                ::new (static_cast<void *>(&_storage)) T{ std::forward<Args>(args)... };
+            }
+
+            explicit control_block_inplace(for_overwrite_t)
+            {
+                ::new (static_cast<void *>(&_storage)) T; // default-initialized
+            }
+
+            // Destructor
+
+            ~control_block_inplace()
+            {
+            }
+
+            // Observers
+
+            T *
+            ptr() noexcept
+            {
+                return reinterpret_cast<T *>(&_storage);
+            }
+
+            void *
+            get_deleter() noexcept override // make_shared has no deleter
+            {
+                return nullptr;
+            }
+
+        private:
+            void
+            dispose() noexcept override
+            {
+                ptr()->~T();
+            }
+
+            void
+            destroy() noexcept override
+            {
+                delete this;
+            }
+
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+        };
+
+        // element initializers of control_block_array
+
+        template<typename T>
+        struct default_init_element
+        {
+            void
+            operator()(void *p) const noexcept(std::is_nothrow_default_constructible<T>::value)
+            {
+                ::new (p) T;
+            }
+        };
+
+        template<typename T>
+        struct value_init_element
+        {
+            void
+            operator()(void *p) const noexcept(std::is_nothrow_default_constructible<T>::value)
+            {
+                ::new (p) T();
+            }
+        };
+
+        template<typename T>
+        struct copy_init_element
+        {
+            const T &init;
+
+            void
+            operator()(void *p) const noexcept(std::is_nothrow_copy_constructible<T>::value)
+            {
+                ::new (p) T(init);
+            }
+        };
+
+        // control block used by the array forms of make_shared
+        // The block is followed by the elements in the same allocation:
+        //  [ vptr | counts | size | align | padding to align | T[size] ]
+        // The allocation is aligned to align, at least alignof(T), so the
+        // elements start on that boundary.
+
+        template<typename T>
+        class control_block_array : public control_block_counted
+        {
+            static_assert(!std::is_array<T>::value, "multidimensional arrays are not supported");
+
+        public:
+            using element_type = T;
+
+            /// Allocates a block for n elements aligned to align and constructs
+            ///     each of them by calling init with its address, in order
+            /// Elements already constructed are destroyed if init throws.
+            template<typename Init>
+            static control_block_array *
+            create(std::size_t n, Init init, std::size_t align = alignof(T))
+            {
+                if (align < alignof(T))
+                    align = alignof(T);
+                if (align < alignof(control_block_array))
+                    align = alignof(control_block_array);
+                std::size_t offset = _offset(align);
+                if (n > (std::size_t(-1) - offset) / sizeof(T))
+                    throw std::bad_array_new_length{};
+                void *mem = allocate_aligned(offset + n * sizeof(T), align);
+                auto *cb = ::new (mem) control_block_array{ n, align };
+                using nothrow = std::integral_constant<bool, noexcept(init(static_cast<void *>(nullptr)))>;
+                try
+                {
+                    _construct_elements(cb->ptr(), n, init, nothrow{});
+                }
+                catch (...)
+                {
+                    cb->~control_block_array();
+                    deallocate_aligned(mem, offset + n * sizeof(T), align);
+                    throw;
+                }
+                return cb;
+            }
+
+            // Observers
+
+            T *
+            ptr() noexcept
+            {
+                return reinterpret_cast<T *>(reinterpret_cast<char *>(this) + _offset(_align));
+            }
+
+            std::size_t
+            size() const noexcept
+            {
+                return _size;
+            }
+
+            void *
+            get_deleter() noexcept override // make_shared has no deleter
+            {
+                return nullptr;
+            }
+
+        private:
+            control_block_array(std::size_t n, std::size_t align) noexcept
+                :
+                _size{ n },
+                _align{ align }
+            {
+            }
+
+            static std::size_t
+            _offset(std::size_t align) noexcept
+            {
+                return (sizeof(control_block_array) + align - 1) & ~(align - 1);
+            }
+
+            // constructs the elements in order, without bookkeeping when
+            // init cannot throw so the loop stays a plain store loop
+
+            template<typename Init>
+            static void
+            _construct_elements(T *p, std::size_t n, Init &init, std::true_type) noexcept
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                    init(static_cast<void *>(p + i));
+            }
+
+            template<typename Init>
+            static void
+            _construct_elements(T *p, std::size_t n, Init &init, std::false_type)
+            {
+                std::size_t i = 0;
+                try
+                {
+                    for (; i < n; ++i)
+                        init(static_cast<void *>(p + i));
+                }
+                catch (...)
+                {
+                    _destroy_elements(p, i, std::is_trivially_destructible<T>{});
+                    throw;
+                }
+            }
+
+            // destroys the elements in reverse order, nothing to do for
+            // trivially destructible types
+
+            static void
+            _destroy_elements(T *, std::size_t, std::true_type) noexcept
+            {
+            }
+
+            static void
+            _destroy_elements(T *p, std::size_t n, std::false_type) noexcept
+            {
+                while (n)
+                    p[--n].~T();
+            }
+
+            void
+            dispose() noexcept override
+            {
+                _destroy_elements(ptr(), _size, std::is_trivially_destructible<T>{});
+            }
+
+            void
+            destroy() noexcept override
+            {
+                std::size_t size = _offset(_align) + _size * sizeof(T);
+                std::size_t align = _align;
+                this->~control_block_array();
+                deallocate_aligned(static_cast<void *>(this), size, align);
+            }
+
+            std::size_t _size;
+            std::size_t _align;
+        };
+
     } // namespace detail
 
 } // namespace smart_ptr
@@ -0,0 +1,147 @@
+// cow_ptr implementation
+
+/**
+ * cow_ptr<T> is a copy-on-write handle to a T. Copying a cow_ptr shares the
+ *  value, read() never copies, and write() clones the value first unless
+ *  this cow_ptr is its only owner, so a value is copied only when one of
+ *  its sharers modifies it.
+ *
+ * Exclusive ownership is decided by the control block, with an acquire
+ *  load of the use count that pairs with the releasing decrements of the
+ *  former owners: once write() sees itself alone, their accesses to the
+ *  value happen before its own. Weak references count as sharers too,
+ *  since a weak_ptr could be locked to observe the value being modified.
+ *
+ * A single cow_ptr object is not thread-safe, distinct cow_ptrs sharing a
+ *  value may be used from different threads, as with shared_ptr.
+ */
+
+#ifndef COW_PTR_HPP
+#define COW_PTR_HPP 1
+
+#include <cassert> // assert
+#include <utility> // forward, move
+
+#include "shared_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    template<typename T>
+    class cow_ptr
+    {
+    public:
+        using element_type = T;
+
+        /// Default constructor, creates an empty cow_ptr
+        cow_ptr() noexcept = default;
+
+        /// Takes over sp, the value is cloned on write while sp has other owners
+        explicit cow_ptr(shared_ptr<T> sp) noexcept
+            :
+            _ptr{ std::move(sp) }
+        {
+        }
+
+        /// Gets the shared value, without copying it
+        /// Precondition: *this is not empty.
+        const T &
+        read() const noexcept
+        {
+            assert(_ptr && "read() of an empty cow_ptr");
+            return *_ptr;
+        }
+
+        /// Gets the value for modification, cloning it first unless *this
+        ///     is its only owner
+        /// Precondition: *this is not empty.
+        T &
+        write()
+        {
+            assert(_ptr && "write() of an empty cow_ptr");
+            if (!unique())
+                _ptr = smart_ptr::make_shared<T>(static_cast<const T &>(*_ptr));
+            return *_ptr;
+        }
+
+        /// Checks whether *this is the only owner of the value, with acquire
+        ///     semantics, an empty cow_ptr is not unique
+        bool
+        unique() const noexcept
+        {
+            detail::control_block_base *cb = detail::shared_ptr_internals::control_block(_ptr);
+            return cb && cb->unique() && cb->weak_use_count() == 0;
+        }
+
+        /// Shares the value as read-only, which makes the next write() clone it
+        shared_ptr<const T>
+        share() const noexcept
+        {
+            return _ptr;
+        }
+
+        const T &
+        operator*() const noexcept
+        {
+            return read();
+        }
+
+        const T *
+        operator->() const noexcept
+        {
+            return _ptr.get();
+        }
+
+        const T *
+        get() const noexcept
+        {
+            return _ptr.get();
+        }
+
+        /// Checks if there is a value
+        explicit operator bool() const noexcept
+        {
+            return bool(_ptr);
+        }
+
+        /// Number of cow_ptrs and shared_ptrs sharing the value, advisory only
+        long
+        use_count() const noexcept
+        {
+            return _ptr.use_count();
+        }
+
+        void
+        swap(cow_ptr &other) noexcept
+        {
+            _ptr.swap(other._ptr);
+        }
+
+        void
+        reset() noexcept
+        {
+            _ptr.reset();
+        }
+
+    private:
+        shared_ptr<T> _ptr;
+    };
+
+    template<typename T>
+    inline void
+    swap(cow_ptr<T> &a, cow_ptr<T> &b) noexcept
+    {
+        a.swap(b);
+    }
+
+    /// Creates a cow_ptr to a new T constructed from args
+    template<typename T, typename... Args>
+    inline cow_ptr<T>
+    make_cow(Args &&...args)
+    {
+        return cow_ptr<T>{ smart_ptr::make_shared<T>(std::forward<Args>(args)...) };
+    }
+
+} // namespace smart_ptr
+
+#endif
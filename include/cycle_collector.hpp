@@ -0,0 +1,578 @@
+// cycle collector implementation
+
+/**
+ * Opt-in collection of reference cycles between shared_ptrs, using the
+ *  synchronous trial deletion algorithm of Bacon and Rajan ("Concurrent
+ *  Cycle Collection in Reference Counted Systems", ECOOP 2001).
+ *
+ * Objects created with make_cycle_collectable<T>(args...) live in a
+ *  collectable control block. T must expose its outgoing shared_ptr
+ *  edges through a trace hook:
+ *
+ *      struct node
+ *      {
+ *          shared_ptr<node> next;
+ *          void trace(smart_ptr::cycle_tracer &t) { t(next); }
+ *      };
+ *
+ * Whenever the use_count of a collectable block is decremented to a
+ *  non-zero value, the block is recorded as a candidate root.
+ *  collect_cycles() then trial-deletes the subgraph reachable from the
+ *  candidates: internal references are subtracted, whatever is still
+ *  referenced from outside is restored, and what remains is garbage.
+ *  The work done is proportional to the subgraph reachable from the
+ *  candidates processed, which can be bounded per call.
+ *
+ * Garbage is reclaimed by first resetting every traced edge of every
+ *  garbage object (through the same trace hook) and then dropping the
+ *  objects, so destructors of collected objects see their traced edges
+ *  already empty.
+ *
+ * An exception thrown while edges are reported, such as bad_alloc from
+ *  the tracer, is passed on by collect_cycles() after undoing its trial
+ *  deletion: the colors of the blocks are restored and the candidates
+ *  stay buffered for the next call, nothing has been reclaimed. Resetting
+ *  the edges allocates nothing, and the trace hook must not throw then.
+ *
+ * Only edges to collectable blocks take part in the collection; a cycle
+ *  that passes through an object managed by another control block is
+ *  not detected. Recording candidates is thread-safe, but the traced
+ *  graph must not be mutated while collect_cycles() is running.
+ */
+
+#ifndef CYCLE_COLLECTOR_HPP
+#define CYCLE_COLLECTOR_HPP 1
+
+#include <cstddef> // size_t
+#include <new> // placement new
+#include <deque> // deque
+#include <vector> // vector
+#include <mutex> // mutex, lock_guard
+#include <atomic> // atomic
+#include <limits> // numeric_limits
+#include <utility> // forward, pair
+#include <algorithm> // min
+#include <type_traits> // aligned_storage
+
+#include "control_block.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    class cycle_tracer;
+
+    namespace detail
+    {
+
+        class cycle_collector;
+
+        // control block interface for cycle-collectable objects
+        // Holds the per-block state of the trial deletion.
+
+        class control_block_cc_base : public control_block_base
+        {
+        public:
+            // Modifiers
+
+            void
+            inc_ref() noexcept override
+            {
+                ++_use_count;
+            }
+
+            bool
+            try_inc_ref() noexcept override
+            {
+                long n = _use_count.load(std::memory_order_relaxed);
+                while (n != 0)
+                    if (_use_count.compare_exchange_weak(n, n + 1))
+                        return true;
+                return false;
+            }
+
+            void
+            inc_wref() noexcept override
+            {
+                ++_weak_use_count;
+            }
+
+            inline void dec_ref() noexcept override;
+
+            void
+            dec_wref() noexcept override
+            {
+                if (--_weak_use_count == 0)
+                {
+                    delete this; // destroy control_block itself
+                }
+            }
+
+            // Observers
+
+            long
+            use_count() const noexcept override // Returns #shared_ptr
+            {
+                return _use_count;
+            }
+
+            bool
+            unique() const noexcept override
+            {
+                // acquire pairs with the release of the decrements, so the
+                // writes of the other owners happen before whatever the
+                // caller does to the object it now owns alone
+                return _use_count.load(std::memory_order_acquire) == 1;
+            }
+
+            long
+            weak_use_count() const noexcept override // Returns #weak_ptr
+            {
+                return _weak_use_count - ((_use_count > 0) ? 1 : 0);
+            }
+
+            bool
+            expired() const noexcept override
+            {
+                return _use_count == 0;
+            }
+
+            void *
+            get_deleter() noexcept override // make_cycle_collectable has no deleter
+            {
+                return nullptr;
+            }
+
+        protected:
+            /// Destroys the managed object
+            virtual void dispose() noexcept = 0;
+
+            /// Reports (or resets) the traced edges of the managed object
+            /// Reporting may throw bad_alloc, resetting does not throw.
+            virtual void trace(cycle_tracer &t) = 0;
+
+        private:
+            friend class cycle_collector;
+
+            enum color : unsigned char
+            {
+                black, // in use or free
+                gray, // possible member of a cycle
+                white, // member of a garbage cycle
+                purple, // possible root of a cycle
+                collecting // being reclaimed by the collector
+            };
+
+            inline void possible_root() noexcept;
+
+            std::atomic<long> _use_count{ 1 };
+            std::atomic<long> _weak_use_count{ 1 }; // Note: a buffered block holds one extra weak reference
+            std::atomic<unsigned char> _color{ black };
+            std::atomic<bool> _buffered{ false };
+            long _trial_count = 0; // only touched by the collector
+        };
+
+        // control block of make_cycle_collectable
+        // The object lives inside the control block, like make_shared.
+
+        template<typename T>
+        class control_block_cc : public control_block_cc_base, public aligned_new<alignof(T)>
+        {
+        public:
+            using element_type = T;
+
+            template<typename... Args>
+            explicit control_block_cc(Args &&...args)
+            {
+                ::new (static_cast<void *>(&_storage)) T{ std::forward<Args>(args)... };
+            }
+
+            T *
+            ptr() noexcept
+            {
+                return reinterpret_cast<T *>(&_storage);
+            }
+
+        private:
+            void
+            dispose() noexcept override
+            {
+                ptr()->~T();
+            }
+
+            void
+            trace(cycle_tracer &t) override
+            {
+                if (use_count() > 0)
+                    ptr()->trace(t);
+            }
+
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+        };
+
+    } // namespace detail
+
+    // Visitor handed to the trace hook of collectable objects
+
+    class cycle_tracer
+    {
+    public:
+        /// Reports one outgoing edge of the traced object
+        template<typename U>
+        void
+        operator()(shared_ptr<U> &edge)
+        {
+            if (_clearing)
+            {
+                edge.reset();
+                return;
+            }
+            auto *cb = dynamic_cast<detail::control_block_cc_base *>(
+                detail::shared_ptr_internals::control_block(edge));
+            if (cb)
+                _edges->push_back(cb);
+        }
+
+    private:
+        friend class detail::cycle_collector;
+
+        cycle_tracer(std::vector<detail::control_block_cc_base *> *edges, bool clearing) noexcept
+            :
+            _edges{ edges },
+            _clearing{ clearing }
+        {
+        }
+
+        std::vector<detail::control_block_cc_base *> *_edges;
+        bool _clearing;
+    };
+
+    namespace detail
+    {
+
+        // process-wide candidate buffer and the trial deletion passes
+
+        class cycle_collector
+        {
+        public:
+            using node = control_block_cc_base;
+
+            static cycle_collector &
+            instance()
+            {
+                static cycle_collector collector;
+                return collector;
+            }
+
+            /// Records a candidate root, the caller holds a weak reference for the buffer
+            bool
+            add_candidate(node *n) noexcept
+            {
+                try
+                {
+                    std::lock_guard<std::mutex> lock{ _candidates_mutex };
+                    _candidates.push_back(n);
+                    return true;
+                }
+                catch (...)
+                {
+                    return false;
+                }
+            }
+
+            std::size_t
+            candidates() const
+            {
+                std::lock_guard<std::mutex> lock{ _candidates_mutex };
+                return _candidates.size();
+            }
+
+            /// Runs trial deletion over at most max_candidates candidate roots
+            /// Returns the number of objects reclaimed.
+            std::size_t
+            collect(std::size_t max_candidates)
+            {
+                std::lock_guard<std::mutex> collecting{ _collect_mutex };
+
+                // the roots stay buffered until the passes below succeed
+                std::vector<node *> roots;
+                {
+                    std::lock_guard<std::mutex> lock{ _candidates_mutex };
+                    std::size_t n = std::min(_candidates.size(), max_candidates);
+                    roots.assign(_candidates.begin(), _candidates.begin() + n);
+                }
+                std::vector<node *> live_roots;
+                std::vector<node *> dead_roots;
+                live_roots.reserve(roots.size());
+                dead_roots.reserve(roots.size());
+
+                std::vector<node *> garbage;
+                _painted.clear();
+                try
+                {
+                    // MarkRoots
+                    for (node *s : roots)
+                    {
+                        if (s->_color.load() == node::purple && s->use_count() > 0)
+                        {
+                            mark_gray(s);
+                            live_roots.push_back(s);
+                        }
+                        else
+                        {
+                            dead_roots.push_back(s);
+                        }
+                    }
+
+                    // ScanRoots
+                    for (node *s : live_roots)
+                        scan(s);
+
+                    // CollectRoots
+                    for (node *s : dead_roots)
+                        s->_buffered.store(false); // may still be white, reached from another root
+                    for (node *s : live_roots)
+                    {
+                        s->_buffered.store(false);
+                        collect_white(s, garbage);
+                    }
+                }
+                catch (...)
+                {
+                    // repaint in reverse order, so each node gets back the
+                    // color it had before the first paint
+                    for (auto it = _painted.rbegin(); it != _painted.rend(); ++it)
+                        it->first->_color.store(it->second);
+                    for (node *s : roots)
+                        s->_buffered.store(true);
+                    throw;
+                }
+                _painted.clear();
+
+                {
+                    std::lock_guard<std::mutex> lock{ _candidates_mutex };
+                    _candidates.erase(_candidates.begin(), _candidates.begin() + roots.size());
+                }
+                for (node *s : dead_roots)
+                    s->dec_wref(); // release the buffer reference, may free a dead block
+
+                reclaim(garbage);
+
+                for (node *s : live_roots)
+                    s->dec_wref();
+
+                return garbage.size();
+            }
+
+        private:
+            cycle_collector() = default;
+
+            /// Sets the color of n, saved first so an interrupted
+            ///     collection can restore it
+            void
+            paint(node *n, unsigned char c)
+            {
+                _painted.emplace_back(n, n->_color.load());
+                n->_color.store(c);
+            }
+
+            void
+            children(node *n, std::vector<node *> &out)
+            {
+                out.clear();
+                cycle_tracer t{ &out, false };
+                n->trace(t);
+            }
+
+            // Subtracts internal references from the trial counts
+            void
+            mark_gray(node *s)
+            {
+                if (s->_color.load() == node::gray)
+                    return;
+                paint(s, node::gray);
+                s->_trial_count = s->use_count();
+                _stack.assign(1, s);
+                while (!_stack.empty())
+                {
+                    node *n = _stack.back();
+                    _stack.pop_back();
+                    children(n, _edges);
+                    for (node *t : _edges)
+                    {
+                        if (t->_color.load() != node::gray)
+                        {
+                            paint(t, node::gray);
+                            t->_trial_count = t->use_count();
+                            _stack.push_back(t);
+                        }
+                        --t->_trial_count;
+                    }
+                }
+            }
+
+            // Whites out what is only referenced internally
+            void
+            scan(node *s)
+            {
+                std::vector<node *> pending(1, s);
+                std::vector<node *> edges;
+                while (!pending.empty())
+                {
+                    node *n = pending.back();
+                    pending.pop_back();
+                    if (n->_color.load() != node::gray)
+                        continue;
+                    if (n->_trial_count > 0)
+                    {
+                        scan_black(n);
+                        continue;
+                    }
+                    paint(n, node::white);
+                    children(n, edges);
+                    pending.insert(pending.end(), edges.begin(), edges.end());
+                }
+            }
+
+            // Restores the trial counts of what is reachable from outside
+            void
+            scan_black(node *s)
+            {
+                paint(s, node::black);
+                _stack.assign(1, s);
+                while (!_stack.empty())
+                {
+                    node *n = _stack.back();
+                    _stack.pop_back();
+                    children(n, _edges);
+                    for (node *t : _edges)
+                    {
+                        ++t->_trial_count;
+                        if (t->_color.load() != node::black)
+                        {
+                            paint(t, node::black);
+                            _stack.push_back(t);
+                        }
+                    }
+                }
+            }
+
+            void
+            collect_white(node *s, std::vector<node *> &garbage)
+            {
+                std::vector<node *> pending(1, s);
+                std::vector<node *> edges;
+                while (!pending.empty())
+                {
+                    node *n = pending.back();
+                    pending.pop_back();
+                    if (n->_color.load() != node::white || n->_buffered.load())
+                        continue;
+                    paint(n, node::collecting);
+                    garbage.push_back(n);
+                    children(n, edges);
+                    pending.insert(pending.end(), edges.begin(), edges.end());
+                }
+            }
+
+            // Breaks the garbage cycles by resetting their edges,
+            // then drops the objects
+            // noexcept: a trace hook throwing while resetting terminates
+            // instead of leaving the garbage half reclaimed.
+            void
+            reclaim(const std::vector<node *> &garbage) noexcept
+            {
+                for (node *n : garbage)
+                    n->inc_ref(); // keep every member alive while edges are reset
+                for (node *n : garbage)
+                {
+                    cycle_tracer t{ nullptr, true };
+                    n->trace(t);
+                }
+                for (node *n : garbage)
+                    n->dec_ref();
+            }
+
+            mutable std::mutex _candidates_mutex;
+            std::deque<node *> _candidates;
+            std::mutex _collect_mutex;
+            std::vector<node *> _stack;
+            std::vector<node *> _edges;
+            std::vector<std::pair<node *, unsigned char>> _painted; // colors before this collection
+        };
+
+        inline void
+        control_block_cc_base::dec_ref() noexcept
+        {
+            // Once the count is decremented the caller no longer owns a
+            // reference and a concurrent final release may free the block:
+            // pin it first, possible_root() hands the pin to the buffer.
+            inc_wref();
+            if (--_use_count == 0)
+            {
+                _color.store(black);
+                dispose(); // destroy the managed object
+                dec_wref();
+                dec_wref();
+            }
+            else
+            {
+                possible_root();
+            }
+        }
+
+        /// Records the block as a candidate root
+        /// The caller holds a weak reference, which is handed to the buffer
+        ///     or released.
+        inline void
+        control_block_cc_base::possible_root() noexcept
+        {
+            if (_color.load(std::memory_order_relaxed) == collecting)
+            {
+                dec_wref();
+                return;
+            }
+            _color.store(purple, std::memory_order_relaxed);
+            if (_buffered.load(std::memory_order_relaxed) || _buffered.exchange(true))
+            {
+                dec_wref();
+                return;
+            }
+            if (!cycle_collector::instance().add_candidate(this))
+            {
+                _buffered.store(false);
+                dec_wref();
+            }
+        }
+
+    } // namespace detail
+
+    /// Creates a shared_ptr to a new object whose cycles can be collected
+    /// T must provide void trace(cycle_tracer &) reporting its shared_ptr edges.
+    template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_cycle_collectable(Args &&...args)
+    {
+        auto *cb = new detail::control_block_cc<T>{ std::forward<Args>(args)... };
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+    /// Reclaims garbage cycles reachable from at most max_candidates
+    ///     candidate roots, returns the number of objects reclaimed
+    /// Strong exception guarantee.
+    inline std::size_t
+    collect_cycles(std::size_t max_candidates = std::numeric_limits<std::size_t>::max())
+    {
+        return detail::cycle_collector::instance().collect(max_candidates);
+    }
+
+    /// Number of candidate roots waiting for the next collect_cycles()
+    inline std::size_t
+    cycle_candidates()
+    {
+        return detail::cycle_collector::instance().candidates();
+    }
+
+} // namespace smart_ptr
+
+#endif
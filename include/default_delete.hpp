@@ -8,6 +8,11 @@
 #ifndef DEFAULT_DELETE_HPP
 #define DEFAULT_DELETE_HPP 1
 
+#include <cstddef> // size_t
+#include <type_traits> // is_trivially_destructible
+
+#include "aligned_new.hpp"
+
 namespace smart_ptr
 {
 
@@ -29,6 +34,8 @@ namespace smart_ptr
         }
 
         /// Call operator
+        /// With sized deallocation (C++14) the compiler passes sizeof(T),
+        ///     or the size of the dynamic type for a virtual destructor.
         void operator()(T *p) const
         {
             delete p;
@@ -51,12 +58,54 @@ namespace smart_ptr
         }
 
         /// Call operator
+        /// The element count is not known here, so delete[] of a trivially
+        ///     destructible T is unsized. make_shared<T[]> and
+        ///     make_unique_aligned<T[]> record it and free sized.
         void operator()(T *p) const
         {
             delete[] p;
         }
     };
 
+    // aligned_delete<T[]>, deleter of the arrays made by make_unique_aligned
+    // Stateless: the element count and the alignment are stored in a
+    // header right in front of the elements.
+
+    template<typename T>
+    class aligned_delete;
+
+    template<typename T>
+    class aligned_delete<T[]>
+    {
+    public:
+        /// Default constructor
+        constexpr aligned_delete() noexcept = default;
+
+        /// Call operator: destroys the elements and frees the allocation
+        void operator()(T *p) const noexcept
+        {
+            const detail::aligned_array_header *h = reinterpret_cast<const detail::aligned_array_header *>(p) - 1;
+            std::size_t size = h->size;
+            std::size_t align = h->align;
+            _destroy(p, size, std::is_trivially_destructible<T>{});
+            std::size_t offset = detail::aligned_array_offset(align);
+            detail::deallocate_aligned(reinterpret_cast<char *>(p) - offset, offset + size * sizeof(T), align);
+        }
+
+    private:
+        static void
+        _destroy(T *, std::size_t, std::true_type) noexcept
+        {
+        }
+
+        static void
+        _destroy(T *p, std::size_t n, std::false_type) noexcept
+        {
+            while (n)
+                p[--n].~T();
+        }
+    };
+
 } // namespace smart_ptr
 
 #endif
@@ -0,0 +1,211 @@
+// immortal and make_immortal_shared implementation
+
+/**
+ * Shared pointers to objects that live until the program ends, such as
+ *  singleton services and static tables handed out as shared_ptr for the
+ *  sake of a uniform API.
+ *
+ * Their control block is immortal: it keeps no counts, so copying and
+ *  dropping such a shared_ptr, or locking a weak_ptr to it, is a call to
+ *  an empty function instead of an atomic read-modify-write, and threads
+ *  sharing the object never contend on a counter. The object is never
+ *  destroyed, use_count() reports immortal_use_count and unique() is
+ *  false, so cow_ptr and shared_bytes never write to it in place.
+ *
+ * immortal<T> holds a T together with its own control block. With a
+ *  constexpr constructor of T, a static immortal<T> is constant
+ *  initialized: no allocation and no code run at startup. Neither the T
+ *  nor the block is ever destroyed, so the object stays valid for the
+ *  shared_ptrs that other static objects release during exit.
+ *
+ * make_immortal_shared(obj) shares an object that is not wrapped, which
+ *  must outlive every use of the pointer, through one block shared by
+ *  the whole program: all such pointers have the same owner, they are
+ *  equivalent for owner_less and owner_hash. Use immortal<T> for objects
+ *  that must be told apart by owner.
+ */
+
+#ifndef IMMORTAL_HPP
+#define IMMORTAL_HPP 1
+
+#include <limits> // numeric_limits
+
+#include "control_block.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    /// use_count() of a shared_ptr to an immortal object
+    constexpr long immortal_use_count = std::numeric_limits<long>::max();
+
+    namespace detail
+    {
+
+        // control block of an object that is never destroyed
+        // Its counts are constants, every reference counting operation is
+        // a no-op.
+
+        class control_block_immortal : public control_block_base
+        {
+        public:
+            constexpr control_block_immortal() noexcept = default;
+
+            void
+            inc_ref() noexcept override
+            {
+            }
+
+            bool
+            try_inc_ref() noexcept override
+            {
+                return true;
+            }
+
+            void
+            inc_wref() noexcept override
+            {
+            }
+
+            void
+            dec_ref() noexcept override
+            {
+            }
+
+            void
+            dec_wref() noexcept override
+            {
+            }
+
+            long
+            use_count() const noexcept override
+            {
+                return immortal_use_count;
+            }
+
+            bool
+            unique() const noexcept override
+            {
+                return false;
+            }
+
+            long
+            weak_use_count() const noexcept override
+            {
+                return 0;
+            }
+
+            bool
+            expired() const noexcept override
+            {
+                return false;
+            }
+
+            void *
+            get_deleter() noexcept override // nothing is ever deleted
+            {
+                return nullptr;
+            }
+        };
+
+        // storage that never destroys its value
+        // Constructing through static_cast instead of std::forward, which
+        // is not constexpr before C++14, keeps the constructor usable for
+        // constant initialization.
+
+        template<typename T>
+        union immortal_storage
+        {
+            template<typename... Args>
+            constexpr explicit immortal_storage(Args &&... args)
+                :
+                value(static_cast<Args &&>(args)...)
+            {
+            }
+
+            ~immortal_storage()
+            {
+            }
+
+            T value;
+        };
+
+        // the block shared by make_immortal_shared, a static data member of
+        // a class template so the header can define it, constant
+        // initialized
+
+        template<typename = void>
+        struct immortal_program_block
+        {
+            static immortal_storage<control_block_immortal> block;
+        };
+
+        template<typename Unused>
+        immortal_storage<control_block_immortal> immortal_program_block<Unused>::block{};
+
+    } // namespace detail
+
+    // immortal
+    // A T with its own immortal control block.
+
+    template<typename T>
+    class immortal
+    {
+    public:
+        /// Constructs the T from args, at compile time for a static
+        ///     immortal if T's constructor is constexpr
+        template<typename... Args>
+        constexpr explicit immortal(Args &&... args)
+            :
+            _block{},
+            _value(static_cast<Args &&>(args)...)
+        {
+        }
+
+        immortal(const immortal &) = delete;
+        immortal &operator=(const immortal &) = delete;
+
+        /// Shares the object, without touching any counter
+        shared_ptr<T>
+        share() noexcept
+        {
+            return detail::shared_ptr_internals::adopt<T>(&_value.value, &_block.value);
+        }
+
+        /// Shares the object as const
+        shared_ptr<const T>
+        share() const noexcept
+        {
+            return detail::shared_ptr_internals::adopt<const T>(&_value.value,
+                const_cast<detail::control_block_immortal *>(&_block.value));
+        }
+
+        T &
+        get() noexcept
+        {
+            return _value.value;
+        }
+
+        const T &
+        get() const noexcept
+        {
+            return _value.value;
+        }
+
+    private:
+        detail::immortal_storage<detail::control_block_immortal> _block;
+        detail::immortal_storage<T> _value;
+    };
+
+    /// Shares obj through the program-wide immortal control block
+    /// Precondition: obj outlives every copy of the returned pointer.
+    template<typename T>
+    inline shared_ptr<T>
+    make_immortal_shared(T &obj) noexcept
+    {
+        return detail::shared_ptr_internals::adopt<T>(&obj, &detail::immortal_program_block<>::block.value);
+    }
+
+} // namespace smart_ptr
+
+#endif
@@ -0,0 +1,261 @@
+// make_shared_lazy_weak implementation
+
+/**
+ * make_shared_lazy_weak<T>(args...) creates an object like make_shared,
+ *  in a single allocation with its control block, but the block only
+ *  keeps a strong count. Objects that never get a weak_ptr, most of them,
+ *  save the weak count, and their last release is one atomic operation
+ *  instead of two.
+ *
+ * The count lives in one tagged word. While no weak_ptr has been taken
+ *  it holds the strong count shifted left by one. The first weak_ptr
+ *  allocates a side table with a strong and a weak count, as Swift does,
+ *  and installs it with a CAS that stores the table address with the low
+ *  bit set; from then on both counts are kept in the table and the word
+ *  does not change again. The object is destroyed when the strong count
+ *  drops to 0, the block and the side table when the weak count does.
+ *
+ * While the counts are inline they are updated with CAS loops, since the
+ *  word may be swapped for a table at any time, which costs more than
+ *  make_shared's fetch_add when many threads copy the same pointer.
+ *
+ * weak_ptr's constructors are noexcept, so failing to allocate the side
+ *  table terminates the program.
+ */
+
+#ifndef LAZY_WEAK_HPP
+#define LAZY_WEAK_HPP 1
+
+#include <cstdint> // uintptr_t
+#include <atomic> // atomic
+#include <new> // placement new
+#include <type_traits> // aligned_storage
+#include <utility> // forward
+
+#include "control_block.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    namespace detail
+    {
+
+        // counts of a control_block_lazy_weak once a weak_ptr exists
+        // Same convention as control_block_counted: weak is the number of
+        // weak_ptrs, plus one while strong is not 0.
+
+        struct lazy_weak_side_table
+        {
+            std::atomic<long> strong;
+            std::atomic<long> weak;
+        };
+
+        // control block used by make_shared_lazy_weak
+        // _word is 2 * strong count while the low bit is clear, the address
+        // of the side table with the low bit set otherwise.
+
+        template<typename T>
+        class control_block_lazy_weak : public control_block_base, public aligned_new<alignof(T)>
+        {
+        public:
+            using element_type = T;
+
+            // Constructors
+
+            template<typename... Args>
+            explicit control_block_lazy_weak(Args &&...args)
+            {
+                ::new (static_cast<void *>(&_storage)) T{ std::forward<Args>(args)... };
+            }
+
+            // Destructor
+
+            ~control_block_lazy_weak()
+            {
+            }
+
+            // Modifiers
+
+            void
+            inc_ref() noexcept override
+            {
+                std::uintptr_t w = _word.load(std::memory_order_acquire);
+                while (!_is_side(w))
+                    if (_word.compare_exchange_weak(w, w + 2, std::memory_order_acquire))
+                        return;
+                _side(w)->strong.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            bool
+            try_inc_ref() noexcept override
+            {
+                std::uintptr_t w = _word.load(std::memory_order_acquire);
+                while (!_is_side(w))
+                {
+                    if (w == 0)
+                        return false;
+                    if (_word.compare_exchange_weak(w, w + 2, std::memory_order_acquire))
+                        return true;
+                }
+                std::atomic<long> &strong = _side(w)->strong;
+                long n = strong.load(std::memory_order_relaxed);
+                while (n != 0)
+                    if (strong.compare_exchange_weak(n, n + 1))
+                        return true;
+                return false;
+            }
+
+            void
+            inc_wref() noexcept override
+            {
+                _side_table()->weak.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void
+            dec_ref() noexcept override
+            {
+                std::uintptr_t w = _word.load(std::memory_order_acquire);
+                while (!_is_side(w))
+                {
+                    if (_word.compare_exchange_weak(w, w - 2, std::memory_order_acq_rel, std::memory_order_acquire))
+                    {
+                        if (w == 2) // no weak_ptr was ever taken, nor can be
+                        {
+                            dispose();
+                            delete this;
+                        }
+                        return;
+                    }
+                }
+                if (_side(w)->strong.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    dispose();
+                    dec_wref();
+                }
+            }
+
+            void
+            dec_wref() noexcept override
+            {
+                lazy_weak_side_table *side = _side(_word.load(std::memory_order_acquire));
+                if (side->weak.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    delete side;
+                    delete this;
+                }
+            }
+
+            // Observers
+
+            long
+            use_count() const noexcept override // Returns #shared_ptr
+            {
+                std::uintptr_t w = _word.load(std::memory_order_acquire);
+                return _is_side(w) ? _side(w)->strong.load() : long(w >> 1);
+            }
+
+            bool
+            unique() const noexcept override
+            {
+                // acquire, as control_block_counted::unique()
+                std::uintptr_t w = _word.load(std::memory_order_acquire);
+                return _is_side(w) ? _side(w)->strong.load(std::memory_order_acquire) == 1 : w == 2;
+            }
+
+            long
+            weak_use_count() const noexcept override // Returns #weak_ptr
+            {
+                std::uintptr_t w = _word.load(std::memory_order_acquire);
+                if (!_is_side(w))
+                    return 0;
+                lazy_weak_side_table *side = _side(w);
+                return side->weak - ((side->strong > 0) ? 1 : 0);
+            }
+
+            bool
+            expired() const noexcept override
+            {
+                return use_count() == 0;
+            }
+
+            T *
+            ptr() noexcept
+            {
+                return reinterpret_cast<T *>(&_storage);
+            }
+
+            void *
+            get_deleter() noexcept override // make_shared_lazy_weak has no deleter
+            {
+                return nullptr;
+            }
+
+            /// Checks whether the side table has been allocated
+            bool
+            has_side_table() const noexcept
+            {
+                return _is_side(_word.load(std::memory_order_acquire));
+            }
+
+        private:
+            static bool
+            _is_side(std::uintptr_t w) noexcept
+            {
+                return (w & 1) != 0;
+            }
+
+            static lazy_weak_side_table *
+            _side(std::uintptr_t w) noexcept
+            {
+                return reinterpret_cast<lazy_weak_side_table *>(w & ~std::uintptr_t(1));
+            }
+
+            /// Gets the side table, allocating it on first use
+            /// Only called with a strong or a weak reference held, so the
+            ///     strong count moved to the table is not 0.
+            lazy_weak_side_table *
+            _side_table() noexcept
+            {
+                std::uintptr_t w = _word.load(std::memory_order_acquire);
+                if (_is_side(w))
+                    return _side(w);
+                lazy_weak_side_table *side = new lazy_weak_side_table; // terminates on bad_alloc
+                side->weak.store(1, std::memory_order_relaxed);
+                do
+                {
+                    side->strong.store(long(w >> 1), std::memory_order_relaxed);
+                    if (_word.compare_exchange_weak(w, reinterpret_cast<std::uintptr_t>(side) | 1,
+                            std::memory_order_acq_rel, std::memory_order_acquire))
+                        return side;
+                } while (!_is_side(w));
+                delete side; // another thread installed its table first
+                return _side(w);
+            }
+
+            void
+            dispose() noexcept
+            {
+                ptr()->~T();
+            }
+
+            std::atomic<std::uintptr_t> _word{ 2 };
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+        };
+
+    } // namespace detail
+
+    /// Creates a shared_ptr that manages a new object, whose control block
+    ///     allocates the weak count only when a weak_ptr is taken
+    /// The object and its control block share a single allocation.
+    template<typename T, typename... Args>
+    inline typename _Shared_if<T>::_Single_object
+    make_shared_lazy_weak(Args &&...args)
+    {
+        auto *cb = new detail::control_block_lazy_weak<T>{ std::forward<Args>(args)... };
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+} // namespace smart_ptr
+
+#endif
@@ -0,0 +1,752 @@
+// offset_ptr, offset_unique_ptr and offset_shared_ptr implementation
+
+/**
+ * Smart pointers that can live inside a memory segment shared between
+ *  processes, such as a memfd or a shm_open object mapped by each of
+ *  them, possibly at different addresses.
+ *
+ * offset_ptr<T> stores the distance from itself to the object instead of
+ *  an absolute address, so it stays valid wherever the segment is mapped
+ *  as long as both ends are in the segment.
+ *
+ * segment manages the memory of a mapping. Its bookkeeping lives in a
+ *  header at the start of the mapping, so any process that attaches to
+ *  the segment can allocate from it and free into it. Blocks are carved
+ *  from the segment in size classes, 16-byte aligned, and recycled through
+ *  a free list per class, under a spin lock in the header.
+ *
+ * offset_unique_ptr<T> and offset_shared_ptr<T> own objects created in a
+ *  segment by make_offset_unique and make_offset_shared. The object, its
+ *  reference count and a link back to the segment are one block of the
+ *  segment, so the last owner frees it whichever process it is in. Both
+ *  pointers are a single offset, sizeof(std::ptrdiff_t) bytes, and can
+ *  be members of objects in the segment to build graphs of them.
+ *
+ * Counts are lock-free atomics, which are address-free and therefore work
+ *  across processes. Neither the pointers nor the segment use type erased
+ *  deleters or virtual functions, whose addresses differ from process to
+ *  process. For the same reason the objects must not contain absolute
+ *  pointers or have virtual functions unless every process is forked from
+ *  the one that created them, and an offset_shared_ptr<T> always destroys
+ *  a T: there are no converting constructors.
+ */
+
+#ifndef OFFSET_PTR_HPP
+#define OFFSET_PTR_HPP 1
+
+#include <cassert> // assert
+#include <cstddef> // size_t, ptrdiff_t, nullptr_t
+#include <cstdint> // uintptr_t, uint64_t
+#include <new> // placement new, bad_alloc
+#include <atomic> // atomic, ATOMIC_INT_LOCK_FREE, ATOMIC_LONG_LOCK_FREE
+#include <thread> // this_thread::yield
+#include <utility> // forward, swap
+#include <type_traits> // aligned_storage, add_lvalue_reference
+
+namespace smart_ptr
+{
+
+    static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LONG_LOCK_FREE == 2,
+        "segment counts and locks must be lock-free to work across processes");
+
+    // self-relative pointer
+    // Null is stored as 1, since a T never starts one byte past the
+    // offset_ptr pointing to it.
+
+    template<typename T>
+    class offset_ptr
+    {
+    public:
+        using element_type = T;
+
+        offset_ptr() noexcept = default;
+
+        offset_ptr(std::nullptr_t) noexcept
+        {
+        }
+
+        offset_ptr(T *p) noexcept
+            :
+            _offset{ _to(p) }
+        {
+        }
+
+        offset_ptr(const offset_ptr &other) noexcept
+            :
+            _offset{ _to(other.get()) }
+        {
+        }
+
+        offset_ptr &
+        operator=(const offset_ptr &other) noexcept
+        {
+            _offset = _to(other.get());
+            return *this;
+        }
+
+        offset_ptr &
+        operator=(T *p) noexcept
+        {
+            _offset = _to(p);
+            return *this;
+        }
+
+        T *
+        get() const noexcept
+        {
+            if (_offset == 1)
+                return nullptr;
+            return reinterpret_cast<T *>(reinterpret_cast<std::uintptr_t>(this) + _offset);
+        }
+
+        typename std::add_lvalue_reference<T>::type
+        operator*() const noexcept
+        {
+            assert(get() != nullptr);
+            return *get();
+        }
+
+        T *
+        operator->() const noexcept
+        {
+            return get();
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return _offset != 1;
+        }
+
+    private:
+        std::ptrdiff_t
+        _to(const T *p) const noexcept
+        {
+            if (!p)
+                return 1;
+            return std::ptrdiff_t(reinterpret_cast<std::uintptr_t>(p) - reinterpret_cast<std::uintptr_t>(this));
+        }
+
+        std::ptrdiff_t _offset = 1;
+    };
+
+    template<typename T, typename U>
+    inline bool
+    operator==(const offset_ptr<T> &a, const offset_ptr<U> &b) noexcept
+    {
+        return a.get() == b.get();
+    }
+
+    template<typename T, typename U>
+    inline bool
+    operator!=(const offset_ptr<T> &a, const offset_ptr<U> &b) noexcept
+    {
+        return a.get() != b.get();
+    }
+
+    template<typename T>
+    class offset_unique_ptr;
+
+    template<typename T>
+    class offset_shared_ptr;
+
+    class segment;
+
+    namespace detail
+    {
+
+        constexpr std::size_t segment_granule = 16; // alignment of every block
+        constexpr std::size_t segment_small_max = 512; // small classes step by segment_granule
+        constexpr std::size_t segment_small_classes = segment_small_max / segment_granule;
+        constexpr std::size_t segment_max_block = std::size_t{ 1 } << 40;
+        constexpr std::size_t segment_classes = segment_small_classes + 4 * (40 - 9); // 4 per power of two above
+        constexpr std::uint64_t segment_magic = 0x736d6172745f7367ull;
+
+        // bookkeeping at the start of a segment
+        // Free lists hold offsets from the start of the segment, 0 is none,
+        // and a free block starts with the offset of the next one.
+
+        struct segment_header
+        {
+            std::uint64_t magic;
+            std::size_t size;
+            std::atomic<int> lock;
+            std::size_t top;
+            std::size_t free_lists[segment_classes];
+            std::size_t root; // block of the root offset_shared_ptr, 0 if none
+        };
+
+        struct segment_free_block
+        {
+            std::size_t next;
+        };
+
+        // size class of a block and the bytes it really takes
+        // Blocks are never split or merged, so the classes bound the waste:
+        // 16-byte steps up to 512 bytes, then four classes per power of two.
+
+        struct segment_class
+        {
+            std::size_t index;
+            std::size_t bytes;
+        };
+
+        inline segment_class
+        segment_class_of(std::size_t size) noexcept
+        {
+            if (size <= segment_small_max)
+            {
+                std::size_t granules = size ? (size + segment_granule - 1) / segment_granule : 1;
+                return segment_class{ granules - 1, granules * segment_granule };
+            }
+            std::size_t p = 9; // size is in (2^p, 2^(p+1)]
+            while ((std::size_t{ 1 } << (p + 1)) < size)
+                ++p;
+            std::size_t step = std::size_t{ 1 } << (p - 2);
+            std::size_t q = (size + step - 1) / step; // 5 to 8 steps
+            return segment_class{ segment_small_classes + (p - 9) * 4 + (q - 5), q * step };
+        }
+
+        // block of make_offset_unique
+
+        template<typename T>
+        struct offset_unique_block
+        {
+            offset_ptr<segment_header> seg;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+            T *
+            ptr() noexcept
+            {
+                return reinterpret_cast<T *>(&storage);
+            }
+        };
+
+        // block of make_offset_shared
+
+        template<typename T>
+        struct offset_shared_block
+        {
+            offset_ptr<segment_header> seg;
+            std::atomic<long> use_count;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+            T *
+            ptr() noexcept
+            {
+                return reinterpret_cast<T *>(&storage);
+            }
+        };
+
+    } // namespace detail
+
+    // memory of a mapping shared between processes
+    // A segment object is a process-local handle, copying it is cheap.
+
+    class segment
+    {
+    public:
+        /// Formats size bytes at base as a new, empty segment
+        /// base must be aligned to 16 bytes, as mmap results are.
+        static segment
+        create(void *base, std::size_t size)
+        {
+            assert(!(reinterpret_cast<std::uintptr_t>(base) % detail::segment_granule) && "misaligned segment");
+            assert(size >= _first_block() && "segment too small for its header");
+            auto *h = ::new (base) detail::segment_header{};
+            h->size = size;
+            h->lock.store(0, std::memory_order_relaxed);
+            h->top = _first_block();
+            h->magic = detail::segment_magic;
+            std::atomic_thread_fence(std::memory_order_release);
+            return segment{ h };
+        }
+
+        /// Attaches to a segment created by another process, or by this one
+        ///     through another mapping
+        static segment
+        attach(void *base) noexcept
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            auto *h = static_cast<detail::segment_header *>(base);
+            assert(h->magic == detail::segment_magic && "not a segment");
+            return segment{ h };
+        }
+
+        /// Allocates size bytes aligned to 16 from the segment
+        /// Throws std::bad_alloc when the segment is full.
+        void *
+        allocate(std::size_t size)
+        {
+            if (size > detail::segment_max_block)
+                throw std::bad_alloc{};
+            detail::segment_class c = detail::segment_class_of(size);
+            _lock();
+            std::size_t offset = _take(c);
+            _unlock();
+            if (!offset)
+                throw std::bad_alloc{};
+            return _at(offset);
+        }
+
+        /// Gives back a block of size bytes obtained from allocate(size)
+        void
+        deallocate(void *p, std::size_t size) noexcept
+        {
+            assert(contains(p) && "block from another segment");
+            detail::segment_class c = detail::segment_class_of(size);
+            std::size_t offset = std::size_t(static_cast<char *>(p) - base());
+            _lock();
+            _at(offset)->next = _header->free_lists[c.index];
+            _header->free_lists[c.index] = offset;
+            _unlock();
+        }
+
+        // Observers
+
+        char *
+        base() const noexcept
+        {
+            return reinterpret_cast<char *>(_header);
+        }
+
+        std::size_t
+        size() const noexcept
+        {
+            return _header->size;
+        }
+
+        /// Bytes never handed out yet, free lists excluded
+        std::size_t
+        unused() const noexcept
+        {
+            return _header->size - _header->top;
+        }
+
+        bool
+        contains(const void *p) const noexcept
+        {
+            const char *c = static_cast<const char *>(p);
+            return c >= base() + _first_block() && c < base() + _header->size;
+        }
+
+        /// Publishes sp as the root of the segment, where other processes
+        ///     find it with root<T>(); holds a reference until replaced
+        template<typename T>
+        void
+        set_root(const offset_shared_ptr<T> &sp) noexcept;
+
+        /// Gets the root published by set_root, T must be the same type
+        template<typename T>
+        offset_shared_ptr<T>
+        root() const noexcept;
+
+    private:
+        template<typename T>
+        friend class offset_shared_ptr;
+
+        template<typename T>
+        friend class offset_unique_ptr;
+
+        template<typename T, typename... Args>
+        friend offset_unique_ptr<T> make_offset_unique(segment &seg, Args &&...args);
+
+        template<typename T, typename... Args>
+        friend offset_shared_ptr<T> make_offset_shared(segment &seg, Args &&...args);
+
+        explicit segment(detail::segment_header *h) noexcept
+            :
+            _header{ h }
+        {
+        }
+
+        static constexpr std::size_t
+        _first_block() noexcept
+        {
+            return (sizeof(detail::segment_header) + detail::segment_granule - 1) & ~(detail::segment_granule - 1);
+        }
+
+        detail::segment_free_block *
+        _at(std::size_t offset) const noexcept
+        {
+            return reinterpret_cast<detail::segment_free_block *>(base() + offset);
+        }
+
+        void
+        _lock() const noexcept
+        {
+            while (_header->lock.exchange(1, std::memory_order_acquire))
+                while (_header->lock.load(std::memory_order_relaxed))
+                    std::this_thread::yield();
+        }
+
+        void
+        _unlock() const noexcept
+        {
+            _header->lock.store(0, std::memory_order_release);
+        }
+
+        // under the lock: a block of the class from its free list, or a
+        // new one from the untouched end, 0 when the segment is full
+
+        std::size_t
+        _take(detail::segment_class c) noexcept
+        {
+            std::size_t &head = _header->free_lists[c.index];
+            if (std::size_t offset = head)
+            {
+                head = _at(offset)->next;
+                return offset;
+            }
+            if (c.bytes > _header->size - _header->top)
+                return 0;
+            std::size_t offset = _header->top;
+            _header->top += c.bytes;
+            return offset;
+        }
+
+        static segment
+        _of(const offset_ptr<detail::segment_header> &seg) noexcept
+        {
+            return segment{ seg.get() };
+        }
+
+        detail::segment_header *_header;
+    };
+
+    // unique ownership of an object in a segment
+
+    template<typename T>
+    class offset_unique_ptr
+    {
+    public:
+        using element_type = T;
+        using pointer = T *;
+
+        offset_unique_ptr() noexcept = default;
+
+        offset_unique_ptr(std::nullptr_t) noexcept
+        {
+        }
+
+        offset_unique_ptr(offset_unique_ptr &&other) noexcept
+            :
+            _block{ other._block }
+        {
+            other._block = nullptr;
+        }
+
+        offset_unique_ptr &
+        operator=(offset_unique_ptr &&other) noexcept
+        {
+            offset_unique_ptr{ std::move(other) }.swap(*this);
+            return *this;
+        }
+
+        offset_unique_ptr &
+        operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+
+        offset_unique_ptr(const offset_unique_ptr &) = delete;
+        offset_unique_ptr &operator=(const offset_unique_ptr &) = delete;
+
+        ~offset_unique_ptr()
+        {
+            reset();
+        }
+
+        /// Destroys the object and frees its block into its segment
+        void
+        reset() noexcept
+        {
+            if (block_type *b = _block.get())
+            {
+                _block = nullptr;
+                b->ptr()->~T();
+                segment seg = segment::_of(b->seg);
+                b->~block_type();
+                seg.deallocate(b, sizeof(block_type));
+            }
+        }
+
+        void
+        swap(offset_unique_ptr &other) noexcept
+        {
+            block_type *b = _block.get();
+            _block = other._block.get();
+            other._block = b;
+        }
+
+        pointer
+        get() const noexcept
+        {
+            block_type *b = _block.get();
+            return b ? b->ptr() : nullptr;
+        }
+
+        T &
+        operator*() const noexcept
+        {
+            assert(_block && "dereference of an empty offset_unique_ptr");
+            return *get();
+        }
+
+        pointer
+        operator->() const noexcept
+        {
+            return get();
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return bool(_block);
+        }
+
+    private:
+        using block_type = detail::offset_unique_block<T>;
+
+        template<typename U, typename... Args>
+        friend offset_unique_ptr<U> make_offset_unique(segment &seg, Args &&...args);
+
+        offset_ptr<block_type> _block;
+    };
+
+    // shared ownership of an object in a segment, across processes
+
+    template<typename T>
+    class offset_shared_ptr
+    {
+    public:
+        using element_type = T;
+
+        offset_shared_ptr() noexcept = default;
+
+        offset_shared_ptr(std::nullptr_t) noexcept
+        {
+        }
+
+        offset_shared_ptr(const offset_shared_ptr &other) noexcept
+            :
+            _block{ other._block }
+        {
+            if (block_type *b = _block.get())
+                b->use_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        offset_shared_ptr(offset_shared_ptr &&other) noexcept
+            :
+            _block{ other._block }
+        {
+            other._block = nullptr;
+        }
+
+        offset_shared_ptr &
+        operator=(const offset_shared_ptr &other) noexcept
+        {
+            offset_shared_ptr{ other }.swap(*this);
+            return *this;
+        }
+
+        offset_shared_ptr &
+        operator=(offset_shared_ptr &&other) noexcept
+        {
+            offset_shared_ptr{ std::move(other) }.swap(*this);
+            return *this;
+        }
+
+        offset_shared_ptr &
+        operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+
+        ~offset_shared_ptr()
+        {
+            reset();
+        }
+
+        /// Drops the reference, the last owner in any process destroys the
+        ///     object and frees its block into its segment
+        void
+        reset() noexcept
+        {
+            if (block_type *b = _block.get())
+            {
+                _block = nullptr;
+                if (b->use_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    b->ptr()->~T();
+                    segment seg = segment::_of(b->seg);
+                    b->~block_type();
+                    seg.deallocate(b, sizeof(block_type));
+                }
+            }
+        }
+
+        void
+        swap(offset_shared_ptr &other) noexcept
+        {
+            block_type *b = _block.get();
+            _block = other._block.get();
+            other._block = b;
+        }
+
+        T *
+        get() const noexcept
+        {
+            block_type *b = _block.get();
+            return b ? b->ptr() : nullptr;
+        }
+
+        T &
+        operator*() const noexcept
+        {
+            assert(_block && "dereference of an empty offset_shared_ptr");
+            return *get();
+        }
+
+        T *
+        operator->() const noexcept
+        {
+            return get();
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return bool(_block);
+        }
+
+        /// Number of owners in all processes, advisory only
+        long
+        use_count() const noexcept
+        {
+            block_type *b = _block.get();
+            return b ? b->use_count.load(std::memory_order_relaxed) : 0;
+        }
+
+    private:
+        using block_type = detail::offset_shared_block<T>;
+
+        friend class segment;
+
+        template<typename U, typename... Args>
+        friend offset_shared_ptr<U> make_offset_shared(segment &seg, Args &&...args);
+
+        offset_ptr<block_type> _block;
+    };
+
+    template<typename T>
+    inline bool
+    operator==(const offset_shared_ptr<T> &a, const offset_shared_ptr<T> &b) noexcept
+    {
+        return a.get() == b.get();
+    }
+
+    template<typename T>
+    inline bool
+    operator!=(const offset_shared_ptr<T> &a, const offset_shared_ptr<T> &b) noexcept
+    {
+        return a.get() != b.get();
+    }
+
+    template<typename T>
+    inline void
+    swap(offset_unique_ptr<T> &a, offset_unique_ptr<T> &b) noexcept
+    {
+        a.swap(b);
+    }
+
+    template<typename T>
+    inline void
+    swap(offset_shared_ptr<T> &a, offset_shared_ptr<T> &b) noexcept
+    {
+        a.swap(b);
+    }
+
+    /// Creates a T from args in seg, owned by an offset_unique_ptr
+    template<typename T, typename... Args>
+    inline offset_unique_ptr<T>
+    make_offset_unique(segment &seg, Args &&...args)
+    {
+        using block_type = detail::offset_unique_block<T>;
+        static_assert(alignof(block_type) <= detail::segment_granule, "over-aligned types are not supported");
+        void *mem = seg.allocate(sizeof(block_type));
+        auto *b = ::new (mem) block_type;
+        try
+        {
+            ::new (static_cast<void *>(&b->storage)) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            b->~block_type();
+            seg.deallocate(mem, sizeof(block_type));
+            throw;
+        }
+        b->seg = seg._header;
+        offset_unique_ptr<T> up;
+        up._block = b;
+        return up;
+    }
+
+    /// Creates a T from args in seg, owned by an offset_shared_ptr
+    template<typename T, typename... Args>
+    inline offset_shared_ptr<T>
+    make_offset_shared(segment &seg, Args &&...args)
+    {
+        using block_type = detail::offset_shared_block<T>;
+        static_assert(alignof(block_type) <= detail::segment_granule, "over-aligned types are not supported");
+        void *mem = seg.allocate(sizeof(block_type));
+        auto *b = ::new (mem) block_type;
+        try
+        {
+            ::new (static_cast<void *>(&b->storage)) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            b->~block_type();
+            seg.deallocate(mem, sizeof(block_type));
+            throw;
+        }
+        b->seg = seg._header;
+        b->use_count.store(1, std::memory_order_relaxed);
+        offset_shared_ptr<T> sp;
+        sp._block = b;
+        return sp;
+    }
+
+    template<typename T>
+    inline void
+    segment::set_root(const offset_shared_ptr<T> &sp) noexcept
+    {
+        offset_shared_ptr<T> old;
+        offset_shared_ptr<T> keep{ sp };
+        _lock();
+        if (_header->root)
+            old._block = reinterpret_cast<typename offset_shared_ptr<T>::block_type *>(base() + _header->root);
+        _header->root = keep ? std::size_t(reinterpret_cast<char *>(keep._block.get()) - base()) : 0;
+        keep._block = nullptr; // the header owns that reference now
+        _unlock();
+    } // old releases the reference the header held
+
+    template<typename T>
+    inline offset_shared_ptr<T>
+    segment::root() const noexcept
+    {
+        offset_shared_ptr<T> sp;
+        _lock();
+        if (_header->root)
+        {
+            auto *b = reinterpret_cast<typename offset_shared_ptr<T>::block_type *>(base() + _header->root);
+            b->use_count.fetch_add(1, std::memory_order_relaxed);
+            sp._block = b;
+        }
+        _unlock();
+        return sp;
+    }
+
+} // namespace smart_ptr
+
+#endif
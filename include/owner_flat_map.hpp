@@ -0,0 +1,463 @@
+// owner_flat_set and owner_flat_map implementation
+
+/**
+ * Contiguous, owner-ordered containers of shared_ptrs or weak_ptrs, an
+ *  alternative to std::set/std::map with owner_less for small to medium
+ *  sizes where node-based trees thrash the cache.
+ *
+ * Elements are kept sorted by control block address, the same order as
+ *  owner_less. The addresses live in their own array next to the
+ *  pointers (and, for the map, the mapped values), so a lookup only
+ *  touches a dense array of integers: a branchless binary search narrows
+ *  it down to a short run that is finished with a linear count the
+ *  compiler can vectorize. Iteration walks plain vectors.
+ *
+ * Single insertions and erasures are O(n) like any flat container. Use
+ *  the bulk insert(first, last), which sorts and deduplicates the new
+ *  elements once and merges them in linear time, to fill them.
+ */
+
+#ifndef OWNER_FLAT_MAP_HPP
+#define OWNER_FLAT_MAP_HPP 1
+
+#include <cstddef> // size_t
+#include <cstdint> // uintptr_t
+#include <vector> // vector
+#include <utility> // pair, move
+#include <algorithm> // stable_sort, unique
+
+#include "shared_ptr.hpp"
+#include "weak_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    namespace detail
+    {
+
+        template<typename T>
+        inline std::uintptr_t
+        owner_key(const shared_ptr<T> &sp) noexcept
+        {
+            return reinterpret_cast<std::uintptr_t>(shared_ptr_internals::control_block(sp));
+        }
+
+        template<typename T>
+        inline std::uintptr_t
+        owner_key(const weak_ptr<T> &wp) noexcept
+        {
+            return reinterpret_cast<std::uintptr_t>(shared_ptr_internals::control_block(wp));
+        }
+
+        // Index of the first key not less than k in the sorted keys[0, n)
+        inline std::size_t
+        owner_lower_bound(const std::uintptr_t *keys, std::size_t n, std::uintptr_t k) noexcept
+        {
+            const std::uintptr_t *base = keys;
+            const std::uintptr_t *end = keys + n;
+            while (n > 16)
+            {
+                std::size_t half = n / 2;
+                base = (base[half] < k) ? base + half : base; // compiles to a cmov
+                n -= half;
+            }
+            std::size_t i = 0;
+            if (end - keys >= 16)
+            {
+                // everything before base is less than k, so the last 16 keys
+                // up to base + n can be counted with a fixed trip count
+                if (base + 16 > end)
+                    base = end - 16;
+                for (std::size_t j = 0; j < 16; ++j) // vectorizable
+                    i += (base[j] < k) ? 1 : 0;
+            }
+            else
+            {
+                for (std::size_t j = 0; j < n; ++j)
+                    i += (base[j] < k) ? 1 : 0;
+            }
+            return static_cast<std::size_t>(base - keys) + i;
+        }
+
+        // Sorted, owner-unique key array shared by the set and the map
+        // Row i of the derived container is stored at index i of every
+        // parallel array.
+
+        class owner_flat_index
+        {
+        public:
+            std::size_t
+            size() const noexcept
+            {
+                return _keys.size();
+            }
+
+            bool
+            empty() const noexcept
+            {
+                return _keys.empty();
+            }
+
+            /// Position of key k, or size() if absent
+            std::size_t
+            position(std::uintptr_t k) const noexcept
+            {
+                std::size_t i = owner_lower_bound(_keys.data(), _keys.size(), k);
+                return (i < _keys.size() && _keys[i] == k) ? i : _keys.size();
+            }
+
+            /// Insertion point of key k
+            std::size_t
+            lower_bound(std::uintptr_t k) const noexcept
+            {
+                return owner_lower_bound(_keys.data(), _keys.size(), k);
+            }
+
+            /// Control block addresses in owner order
+            const std::vector<std::uintptr_t> &
+            keys() const noexcept
+            {
+                return _keys;
+            }
+
+        protected:
+            std::vector<std::uintptr_t> _keys;
+        };
+
+    } // namespace detail
+
+    // Flat owner-ordered set of shared_ptr<T> or weak_ptr<T>
+
+    template<typename Ptr>
+    class owner_flat_set : public detail::owner_flat_index
+    {
+    public:
+        using value_type = Ptr;
+        using const_iterator = typename std::vector<Ptr>::const_iterator;
+        using iterator = const_iterator;
+
+        owner_flat_set() = default;
+
+        /// Builds the set from a range of pointers in one sort
+        template<typename InputIt>
+        owner_flat_set(InputIt first, InputIt last)
+        {
+            insert(first, last);
+        }
+
+        /// Inserts p unless an element with the same owner is present
+        bool
+        insert(const Ptr &p)
+        {
+            std::uintptr_t k = detail::owner_key(p);
+            std::size_t i = lower_bound(k);
+            if (i < _keys.size() && _keys[i] == k)
+                return false;
+            _keys.insert(_keys.begin() + i, k);
+            _ptrs.insert(_ptrs.begin() + i, p);
+            return true;
+        }
+
+        /// Inserts a range: sorts and deduplicates it, then merges it in
+        /// Elements already present win over new ones with the same owner.
+        template<typename InputIt>
+        void
+        insert(InputIt first, InputIt last)
+        {
+            std::vector<std::pair<std::uintptr_t, Ptr>> rows;
+            for (; first != last; ++first)
+                rows.emplace_back(detail::owner_key(*first), *first);
+            _merge(rows);
+        }
+
+        /// Erases the element sharing ownership with p
+        template<typename P>
+        bool
+        erase(const P &p)
+        {
+            std::size_t i = position(detail::owner_key(p));
+            if (i == _keys.size())
+                return false;
+            _keys.erase(_keys.begin() + i);
+            _ptrs.erase(_ptrs.begin() + i);
+            return true;
+        }
+
+        template<typename P>
+        bool
+        contains(const P &p) const noexcept
+        {
+            return position(detail::owner_key(p)) != _keys.size();
+        }
+
+        template<typename P>
+        std::size_t
+        count(const P &p) const noexcept
+        {
+            return contains(p) ? 1 : 0;
+        }
+
+        template<typename P>
+        const_iterator
+        find(const P &p) const noexcept
+        {
+            return _ptrs.begin() + position(detail::owner_key(p));
+        }
+
+        const_iterator
+        begin() const noexcept
+        {
+            return _ptrs.begin();
+        }
+
+        const_iterator
+        end() const noexcept
+        {
+            return _ptrs.end();
+        }
+
+        void
+        clear() noexcept
+        {
+            _keys.clear();
+            _ptrs.clear();
+        }
+
+        void
+        reserve(std::size_t n)
+        {
+            _keys.reserve(n);
+            _ptrs.reserve(n);
+        }
+
+    private:
+        void
+        _merge(std::vector<std::pair<std::uintptr_t, Ptr>> &rows)
+        {
+            std::stable_sort(rows.begin(), rows.end(),
+                [](const std::pair<std::uintptr_t, Ptr> &a, const std::pair<std::uintptr_t, Ptr> &b) {
+                    return a.first < b.first;
+                });
+            rows.erase(std::unique(rows.begin(), rows.end(),
+                           [](const std::pair<std::uintptr_t, Ptr> &a, const std::pair<std::uintptr_t, Ptr> &b) {
+                               return a.first == b.first;
+                           }),
+                rows.end());
+
+            std::vector<std::uintptr_t> keys;
+            std::vector<Ptr> ptrs;
+            keys.reserve(_keys.size() + rows.size());
+            ptrs.reserve(_keys.size() + rows.size());
+            std::size_t i = 0, j = 0;
+            while (i < _keys.size() || j < rows.size())
+            {
+                if (j == rows.size() || (i < _keys.size() && _keys[i] <= rows[j].first))
+                {
+                    if (j < rows.size() && _keys[i] == rows[j].first)
+                        ++j; // already present
+                    keys.push_back(_keys[i]);
+                    ptrs.push_back(std::move(_ptrs[i]));
+                    ++i;
+                }
+                else
+                {
+                    keys.push_back(rows[j].first);
+                    ptrs.push_back(std::move(rows[j].second));
+                    ++j;
+                }
+            }
+            _keys.swap(keys);
+            _ptrs.swap(ptrs);
+        }
+
+        std::vector<Ptr> _ptrs;
+    };
+
+    // Flat owner-ordered map from shared_ptr<T> or weak_ptr<T> to V
+
+    template<typename Ptr, typename V>
+    class owner_flat_map : public detail::owner_flat_index
+    {
+    public:
+        using key_type = Ptr;
+        using mapped_type = V;
+
+        owner_flat_map() = default;
+
+        /// Inserts (p, v) unless an element with the same owner is present
+        bool
+        insert(const Ptr &p, V v)
+        {
+            std::uintptr_t k = detail::owner_key(p);
+            std::size_t i = lower_bound(k);
+            if (i < _keys.size() && _keys[i] == k)
+                return false;
+            _keys.insert(_keys.begin() + i, k);
+            _ptrs.insert(_ptrs.begin() + i, p);
+            _values.insert(_values.begin() + i, std::move(v));
+            return true;
+        }
+
+        /// Inserts a range of (pointer, value) pairs in one sort and merge
+        /// Elements already present win over new ones with the same owner.
+        template<typename InputIt>
+        void
+        insert(InputIt first, InputIt last)
+        {
+            std::vector<row> rows;
+            for (; first != last; ++first)
+                rows.push_back(row{ detail::owner_key(first->first), first->first, first->second });
+            _merge(rows);
+        }
+
+        /// Returns the value for p, inserting a default one if absent
+        V &
+        operator[](const Ptr &p)
+        {
+            std::uintptr_t k = detail::owner_key(p);
+            std::size_t i = lower_bound(k);
+            if (i == _keys.size() || _keys[i] != k)
+            {
+                _keys.insert(_keys.begin() + i, k);
+                _ptrs.insert(_ptrs.begin() + i, p);
+                _values.insert(_values.begin() + i, V{});
+            }
+            return _values[i];
+        }
+
+        /// Returns the value of the element sharing ownership with p, or nullptr
+        template<typename P>
+        V *
+        find(const P &p) noexcept
+        {
+            std::size_t i = position(detail::owner_key(p));
+            return (i != _keys.size()) ? &_values[i] : nullptr;
+        }
+
+        template<typename P>
+        const V *
+        find(const P &p) const noexcept
+        {
+            std::size_t i = position(detail::owner_key(p));
+            return (i != _keys.size()) ? &_values[i] : nullptr;
+        }
+
+        template<typename P>
+        bool
+        contains(const P &p) const noexcept
+        {
+            return position(detail::owner_key(p)) != _keys.size();
+        }
+
+        template<typename P>
+        std::size_t
+        count(const P &p) const noexcept
+        {
+            return contains(p) ? 1 : 0;
+        }
+
+        /// Erases the element sharing ownership with p
+        template<typename P>
+        bool
+        erase(const P &p)
+        {
+            std::size_t i = position(detail::owner_key(p));
+            if (i == _keys.size())
+                return false;
+            _keys.erase(_keys.begin() + i);
+            _ptrs.erase(_ptrs.begin() + i);
+            _values.erase(_values.begin() + i);
+            return true;
+        }
+
+        /// Pointers in owner order, parallel to values()
+        const std::vector<Ptr> &
+        owners() const noexcept
+        {
+            return _ptrs;
+        }
+
+        /// Mapped values in owner order, parallel to owners()
+        std::vector<V> &
+        values() noexcept
+        {
+            return _values;
+        }
+
+        const std::vector<V> &
+        values() const noexcept
+        {
+            return _values;
+        }
+
+        void
+        clear() noexcept
+        {
+            _keys.clear();
+            _ptrs.clear();
+            _values.clear();
+        }
+
+        void
+        reserve(std::size_t n)
+        {
+            _keys.reserve(n);
+            _ptrs.reserve(n);
+            _values.reserve(n);
+        }
+
+    private:
+        struct row
+        {
+            std::uintptr_t key;
+            Ptr ptr;
+            V value;
+        };
+
+        void
+        _merge(std::vector<row> &rows)
+        {
+            std::stable_sort(rows.begin(), rows.end(),
+                [](const row &a, const row &b) { return a.key < b.key; });
+            rows.erase(std::unique(rows.begin(), rows.end(),
+                           [](const row &a, const row &b) { return a.key == b.key; }),
+                rows.end());
+
+            std::vector<std::uintptr_t> keys;
+            std::vector<Ptr> ptrs;
+            std::vector<V> values;
+            keys.reserve(_keys.size() + rows.size());
+            ptrs.reserve(_keys.size() + rows.size());
+            values.reserve(_keys.size() + rows.size());
+            std::size_t i = 0, j = 0;
+            while (i < _keys.size() || j < rows.size())
+            {
+                if (j == rows.size() || (i < _keys.size() && _keys[i] <= rows[j].key))
+                {
+                    if (j < rows.size() && _keys[i] == rows[j].key)
+                        ++j; // already present
+                    keys.push_back(_keys[i]);
+                    ptrs.push_back(std::move(_ptrs[i]));
+                    values.push_back(std::move(_values[i]));
+                    ++i;
+                }
+                else
+                {
+                    keys.push_back(rows[j].key);
+                    ptrs.push_back(std::move(rows[j].ptr));
+                    values.push_back(std::move(rows[j].value));
+                    ++j;
+                }
+            }
+            _keys.swap(keys);
+            _ptrs.swap(ptrs);
+            _values.swap(values);
+        }
+
+        std::vector<Ptr> _ptrs;
+        std::vector<V> _values;
+    };
+
+} // namespace smart_ptr
+
+#endif
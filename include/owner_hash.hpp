@@ -0,0 +1,91 @@
+// owner_hash and owner_equal implementation
+
+/**
+ * These function objects provide owner-based (as opposed to value-based)
+ *  hashing and equality of both weak_ptr and shared_ptr, so that they can
+ *  key unordered containers. Two smart pointers are equal only if they
+ *  are both empty or if they share ownership, even if the values of the
+ *  raw pointers obtained by get() are different.
+ *
+ * They are the unordered counterpart of owner_less, aka,
+ *  std::unordered_set<weak_ptr<T>, owner_hash, owner_equal> replaces
+ *  std::set<weak_ptr<T>, owner_less<weak_ptr<T>>> with O(1) lookups.
+ *
+ * Both are transparent, so shared_ptrs can look up weak_ptr keys.
+ */
+
+#ifndef OWNER_HASH_HPP
+#define OWNER_HASH_HPP 1
+
+#include <cstddef> // size_t
+
+#include "shared_ptr.hpp"
+#include "weak_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    // Forward declarations
+
+    template<typename T>
+    class shared_ptr;
+    template<typename T>
+    class weak_ptr;
+
+    /* added in C++26 */
+    struct owner_hash
+    {
+        using is_transparent = void;
+
+        template<typename T>
+        std::size_t
+        operator()(const shared_ptr<T> &sp) const noexcept
+        {
+            return sp.owner_hash();
+        }
+
+        template<typename T>
+        std::size_t
+        operator()(const weak_ptr<T> &wp) const noexcept
+        {
+            return wp.owner_hash();
+        }
+    };
+
+    /* added in C++26 */
+    struct owner_equal
+    {
+        using is_transparent = void;
+
+        template<typename T, typename U>
+        bool
+        operator()(const shared_ptr<T> &lhs, const shared_ptr<U> &rhs) const noexcept
+        {
+            return lhs.owner_equal(rhs);
+        }
+
+        template<typename T, typename U>
+        bool
+        operator()(const shared_ptr<T> &lhs, const weak_ptr<U> &rhs) const noexcept
+        {
+            return lhs.owner_equal(rhs);
+        }
+
+        template<typename T, typename U>
+        bool
+        operator()(const weak_ptr<T> &lhs, const shared_ptr<U> &rhs) const noexcept
+        {
+            return lhs.owner_equal(rhs);
+        }
+
+        template<typename T, typename U>
+        bool
+        operator()(const weak_ptr<T> &lhs, const weak_ptr<U> &rhs) const noexcept
+        {
+            return lhs.owner_equal(rhs);
+        }
+    };
+
+} // namespace smart_ptr
+
+#endif
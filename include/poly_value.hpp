@@ -0,0 +1,384 @@
+// poly_value implementation
+
+/**
+ * poly_value<Base, N> owns an object of any type derived from Base, with
+ *  value semantics: copying a poly_value copies the derived object, in the
+ *  spirit of std::polymorphic (added in C++26).
+ *
+ * Objects that fit in N bytes, need no more than max_align_t alignment
+ *  and have a nothrow move constructor are stored inline, so creating,
+ *  moving and destroying them never touches the heap and calls through
+ *  get() do not chase a pointer to another cache line. Other objects are
+ *  allocated on the heap, on their alignment boundary even before C++17,
+ *  and moving them only moves the pointer.
+ *
+ * The derived type is remembered by a static table of copy, move and
+ *  destroy functions, so Base needs no virtual destructor or clone member.
+ *  Base must be a non-virtual base of the stored type.
+ *
+ * Unlike std::polymorphic, a poly_value can be empty, after a move or
+ *  reset(), as a unique_ptr can. Constness propagates: a const poly_value
+ *  only gives access to a const Base.
+ */
+
+#ifndef POLY_VALUE_HPP
+#define POLY_VALUE_HPP 1
+
+#include <cassert> // assert
+#include <cstddef> // size_t, nullptr_t, max_align_t
+#include <new> // placement new
+#include <utility> // move, forward
+#include <type_traits> // aligned_storage, integral_constant, is_base_of, decay, enable_if
+
+#include "aligned_new.hpp"
+
+namespace smart_ptr
+{
+
+    namespace detail
+    {
+
+        // type-erased operations on the object held by a poly_value
+        // copy and move construct into buf when the object is stored inline,
+        // and return the address of the new object's Base.
+
+        template<typename Base>
+        struct poly_value_ops
+        {
+            Base *(*copy)(void *buf, const Base *src);
+            Base *(*move)(void *buf, Base *src) noexcept; // also ends the lifetime of src
+            void (*destroy)(Base *p) noexcept;
+        };
+
+        template<typename Base, typename D, bool Inline>
+        struct poly_value_model;
+
+        template<typename Base, typename D>
+        struct poly_value_model<Base, D, true>
+        {
+            template<typename... Args>
+            static Base *
+            create(void *buf, Args &&...args)
+            {
+                return ::new (buf) D(std::forward<Args>(args)...);
+            }
+
+            static Base *
+            copy(void *buf, const Base *src)
+            {
+                return create(buf, *static_cast<const D *>(src));
+            }
+
+            static Base *
+            move(void *buf, Base *src) noexcept
+            {
+                D *d = static_cast<D *>(src);
+                Base *p = ::new (buf) D(std::move(*d));
+                d->~D();
+                return p;
+            }
+
+            static void
+            destroy(Base *p) noexcept
+            {
+                static_cast<D *>(p)->~D();
+            }
+
+            static constexpr poly_value_ops<Base> ops = { &copy, &move, &destroy };
+        };
+
+        template<typename Base, typename D>
+        constexpr poly_value_ops<Base> poly_value_model<Base, D, true>::ops;
+
+        template<typename Base, typename D>
+        struct poly_value_model<Base, D, false>
+        {
+            // allocated through allocate_aligned, which honours alignof(D)
+            // before C++17 too, over-aligned types all end up here
+            template<typename... Args>
+            static Base *
+            create(void *, Args &&...args)
+            {
+                void *mem = allocate_aligned(sizeof(D), alignof(D));
+                try
+                {
+                    return ::new (mem) D(std::forward<Args>(args)...);
+                }
+                catch (...)
+                {
+                    deallocate_aligned(mem, sizeof(D), alignof(D));
+                    throw;
+                }
+            }
+
+            static Base *
+            copy(void *buf, const Base *src)
+            {
+                return create(buf, *static_cast<const D *>(src));
+            }
+
+            static Base *
+            move(void *, Base *src) noexcept
+            {
+                return src;
+            }
+
+            static void
+            destroy(Base *p) noexcept
+            {
+                D *d = static_cast<D *>(p);
+                d->~D();
+                deallocate_aligned(d, sizeof(D), alignof(D));
+            }
+
+            static constexpr poly_value_ops<Base> ops = { &copy, &move, &destroy };
+        };
+
+        template<typename Base, typename D>
+        constexpr poly_value_ops<Base> poly_value_model<Base, D, false>::ops;
+
+    } // namespace detail
+
+    template<typename Base, std::size_t N = 48>
+    class poly_value
+    {
+    public:
+        using element_type = Base;
+        using pointer = Base *;
+        using const_pointer = const Base *;
+
+        /// Bytes available for inline storage
+        static constexpr std::size_t buffer_size = N;
+
+        /// Checks whether a D is stored inline
+        template<typename D>
+        struct fits_inline : std::integral_constant<bool,
+            sizeof(D) <= N &&
+            alignof(D) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible<D>::value>
+        {
+        };
+
+        // Constructors
+
+        /// Default constructor, creates an empty poly_value
+        poly_value() noexcept = default;
+
+        /// Constructs with nullptr, creates an empty poly_value
+        poly_value(std::nullptr_t) noexcept
+        {
+        }
+
+        /// Holds a copy of d, or d itself moved, as its dynamic type D
+        template<typename D, typename = typename std::enable_if<
+            std::is_base_of<Base, typename std::decay<D>::type>::value>::type>
+        poly_value(D &&d)
+        {
+            emplace<typename std::decay<D>::type>(std::forward<D>(d));
+        }
+
+        /// Copy constructor: copies the held object as its dynamic type
+        poly_value(const poly_value &other)
+        {
+            if (other._ptr)
+            {
+                _ptr = other._ops->copy(_buf(), other._ptr);
+                _ops = other._ops;
+            }
+        }
+
+        /// Move constructor: takes over the held object, other becomes empty
+        poly_value(poly_value &&other) noexcept
+        {
+            _take(other);
+        }
+
+        // Destructor
+
+        ~poly_value()
+        {
+            reset();
+        }
+
+        // Assignment
+
+        /// Copy assignment, leaves *this unchanged if copying throws
+        poly_value &
+        operator=(const poly_value &other)
+        {
+            if (this != &other)
+                *this = poly_value(other);
+            return *this;
+        }
+
+        poly_value &
+        operator=(poly_value &&other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                _take(other);
+            }
+            return *this;
+        }
+
+        poly_value &
+        operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+
+        // Modifiers
+
+        /// Replaces the held object by a D constructed from args
+        /// *this is left empty if the constructor throws.
+        template<typename D, typename... Args>
+        D &
+        emplace(Args &&...args)
+        {
+            static_assert(std::is_base_of<Base, D>::value, "D must derive from Base");
+            static_assert(std::is_copy_constructible<D>::value, "poly_value needs a copyable D");
+            using model = detail::poly_value_model<Base, D, fits_inline<D>::value>;
+            reset();
+            _ptr = model::create(_buf(), std::forward<Args>(args)...);
+            _ops = &model::ops;
+            return *static_cast<D *>(_ptr);
+        }
+
+        /// Destroys the held object, if any
+        void
+        reset() noexcept
+        {
+            if (_ptr)
+            {
+                _ops->destroy(_ptr);
+                _ptr = nullptr;
+                _ops = nullptr;
+            }
+        }
+
+        void
+        swap(poly_value &other) noexcept
+        {
+            poly_value tmp{ std::move(other) };
+            other = std::move(*this);
+            *this = std::move(tmp);
+        }
+
+        // Observers
+
+        pointer
+        get() noexcept
+        {
+            return _ptr;
+        }
+
+        const_pointer
+        get() const noexcept
+        {
+            return _ptr;
+        }
+
+        Base &
+        operator*() noexcept
+        {
+            assert(_ptr && "dereference of an empty poly_value");
+            return *_ptr;
+        }
+
+        const Base &
+        operator*() const noexcept
+        {
+            assert(_ptr && "dereference of an empty poly_value");
+            return *_ptr;
+        }
+
+        pointer
+        operator->() noexcept
+        {
+            return _ptr;
+        }
+
+        const_pointer
+        operator->() const noexcept
+        {
+            return _ptr;
+        }
+
+        /// Checks if there is a held object
+        explicit operator bool() const noexcept
+        {
+            return _ptr != nullptr;
+        }
+
+        /// Checks whether the held object lives in the inline buffer
+        bool
+        is_inline() const noexcept
+        {
+            const char *p = reinterpret_cast<const char *>(_ptr);
+            const char *buf = reinterpret_cast<const char *>(&_storage);
+            return _ptr && p >= buf && p < buf + N;
+        }
+
+    private:
+        void *
+        _buf() noexcept
+        {
+            return static_cast<void *>(&_storage);
+        }
+
+        void
+        _take(poly_value &other) noexcept
+        {
+            if (other._ptr)
+            {
+                _ptr = other._ops->move(_buf(), other._ptr);
+                _ops = other._ops;
+                other._ptr = nullptr;
+                other._ops = nullptr;
+            }
+        }
+
+        Base *_ptr = nullptr; // points into _storage or to the heap
+        const detail::poly_value_ops<Base> *_ops = nullptr;
+        typename std::aligned_storage<N ? N : 1, alignof(std::max_align_t)>::type _storage;
+    };
+
+    template<typename Base, std::size_t N>
+    constexpr std::size_t poly_value<Base, N>::buffer_size;
+
+    template<typename Base, std::size_t N>
+    inline void
+    swap(poly_value<Base, N> &a, poly_value<Base, N> &b) noexcept
+    {
+        a.swap(b);
+    }
+
+    template<typename Base, std::size_t N>
+    inline bool
+    operator==(const poly_value<Base, N> &pv, std::nullptr_t) noexcept
+    {
+        return !pv;
+    }
+
+    template<typename Base, std::size_t N>
+    inline bool
+    operator!=(const poly_value<Base, N> &pv, std::nullptr_t) noexcept
+    {
+        return bool(pv);
+    }
+
+    /// Creates a poly_value<Base, N> holding a D constructed from args
+    template<typename Base, typename D, std::size_t N = 48, typename... Args>
+    inline poly_value<Base, N>
+    make_poly_value(Args &&...args)
+    {
+        poly_value<Base, N> pv;
+        pv.template emplace<D>(std::forward<Args>(args)...);
+        return pv;
+    }
+
+} // namespace smart_ptr
+
+#endif
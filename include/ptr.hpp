@@ -3,7 +3,18 @@
 #ifndef PTR_HPP
 #define PTR_HPP 1
 
-#include <tuple> // tuple, get(tuple)
+#include <utility> // forward
+#include <type_traits> // is_empty, is_final, remove_reference
+
+// accessors that must inline even in -O0 builds, where every call left
+// out of line costs a dereference of a smart pointer a function call
+#if defined(_MSC_VER)
+#define SMART_PTR_FORCE_INLINE __forceinline
+#elif defined(__GNUC__) || defined(__clang__)
+#define SMART_PTR_FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define SMART_PTR_FORCE_INLINE inline
+#endif
 
 namespace smart_ptr
 {
@@ -11,21 +22,166 @@ namespace smart_ptr
     namespace detail
     {
 
-        // Ptr class that wraps the deleter, use tuple for Empty Base Optimization
+        // std::is_final is C++14, the compilers have the builtin before that
+        template<typename T>
+        struct is_final_class : std::integral_constant<bool,
+#if defined(__cpp_lib_is_final) || __cplusplus >= 201402L
+            std::is_final<T>::value
+#else
+            __is_final(T)
+#endif
+            >
+        {
+        };
+
+        // pointer type of a unique_ptr<T, D>: D::pointer when the deleter
+        // names one, T * otherwise, as the standard specifies
+        // D::pointer lets a deleter own handles that are not raw pointers,
+        // it has to be a NullablePointer: default constructible, comparable
+        // with ==, and constructible from and comparable with nullptr.
+
+        template<typename...>
+        struct make_void
+        {
+            using type = void;
+        };
+
+        template<typename T, typename D, typename = void>
+        struct pointer_of
+        {
+            using type = T *;
+        };
+
+        template<typename T, typename D>
+        struct pointer_of<T, D,
+            typename make_void<typename std::remove_reference<D>::type::pointer>::type>
+        {
+            using type = typename std::remove_reference<D>::type::pointer;
+        };
+
+        // pair that takes no room for an empty Second
+        // Empty Base Optimization: an empty, non-final Second is a base
+        // class instead of a member, so it adds nothing to the size.
+
+        template<typename First, typename Second,
+            bool = std::is_empty<Second>::value && !is_final_class<Second>::value>
+        class compressed_pair : private Second
+        {
+        public:
+            constexpr compressed_pair() noexcept(std::is_nothrow_default_constructible<Second>::value) :
+                Second(),
+                _first()
+            {
+            }
+
+            explicit compressed_pair(First f) :
+                Second(),
+                _first(f)
+            {
+            }
+
+            template<typename S>
+            compressed_pair(First f, S &&s) :
+                Second(std::forward<S>(s)),
+                _first(f)
+            {
+            }
+
+            SMART_PTR_FORCE_INLINE First &
+            first() noexcept
+            {
+                return _first;
+            }
+
+            SMART_PTR_FORCE_INLINE const First &
+            first() const noexcept
+            {
+                return _first;
+            }
+
+            SMART_PTR_FORCE_INLINE Second &
+            second() noexcept
+            {
+                return *this;
+            }
+
+            SMART_PTR_FORCE_INLINE const Second &
+            second() const noexcept
+            {
+                return *this;
+            }
+
+        private:
+            First _first;
+        };
+
+        template<typename First, typename Second>
+        class compressed_pair<First, Second, false>
+        {
+        public:
+            constexpr compressed_pair() noexcept(std::is_nothrow_default_constructible<Second>::value) :
+                _first(),
+                _second()
+            {
+            }
+
+            explicit compressed_pair(First f) :
+                _first(f),
+                _second()
+            {
+            }
+
+            template<typename S>
+            compressed_pair(First f, S &&s) :
+                _first(f),
+                _second(std::forward<S>(s))
+            {
+            }
+
+            SMART_PTR_FORCE_INLINE First &
+            first() noexcept
+            {
+                return _first;
+            }
+
+            SMART_PTR_FORCE_INLINE const First &
+            first() const noexcept
+            {
+                return _first;
+            }
+
+            SMART_PTR_FORCE_INLINE Second &
+            second() noexcept
+            {
+                return _second;
+            }
+
+            SMART_PTR_FORCE_INLINE const Second &
+            second() const noexcept
+            {
+                return _second;
+            }
+
+        private:
+            First _first;
+            Second _second;
+        };
+
+        // Ptr class that wraps the deleter, compressed_pair keeps a
+        // stateless deleter from taking any room
 
         template<typename T, typename D>
         class Ptr
         {
         public:
-            using pointer = T *;
+            using pointer = typename pointer_of<T, D>::type;
             using deleter_type = D;
 
             constexpr Ptr() noexcept = default;
 
             Ptr(pointer p) :
-                _impl_t{}
+                _impl_t{ p }
             {
-                _impl_ptr() = p;
             }
 
             template<typename Del>
@@ -36,25 +192,32 @@ namespace smart_ptr
 
             ~Ptr() noexcept = default;
 
-            pointer &_impl_ptr()
+            SMART_PTR_FORCE_INLINE pointer &
+            _impl_ptr() noexcept
             {
-                return std::get<0>(_impl_t);
+                return _impl_t.first();
             }
-            pointer _impl_ptr() const
+
+            SMART_PTR_FORCE_INLINE pointer
+            _impl_ptr() const noexcept
             {
-                return std::get<0>(_impl_t);
+                return _impl_t.first();
             }
-            deleter_type &_impl_deleter()
+
+            SMART_PTR_FORCE_INLINE deleter_type &
+            _impl_deleter() noexcept
             {
-                return std::get<1>(_impl_t);
+                return _impl_t.second();
             }
-            const deleter_type &_impl_deleter() const
+
+            SMART_PTR_FORCE_INLINE const deleter_type &
+            _impl_deleter() const noexcept
             {
-                return std::get<1>(_impl_t);
+                return _impl_t.second();
             }
 
         private:
-            std::tuple<pointer, deleter_type> _impl_t;
+            compressed_pair<pointer, deleter_type> _impl_t;
         };
 
     } // namespace detail
@@ -0,0 +1,322 @@
+// mpmc_ptr_queue and spsc_ptr_queue implementation
+
+/**
+ * Bounded lock-free queues of this library's smart pointers, for handing
+ *  shared_ptr<Job> or unique_ptr<Job> between threads.
+ *
+ * A slot holds the raw parts of a pointer, not a pointer object: try_push
+ *  empties the pushed pointer and stores its element pointer and control
+ *  block (its pointer, for unique_ptr), and try_pop adopts them back into
+ *  a pointer. The reference travels with the slot, so a hop through the
+ *  queue does no atomic operation on the control block, and no pointer is
+ *  constructed or destroyed inside the queue.
+ *
+ * mpmc_ptr_queue is Dmitry Vyukov's bounded MPMC queue: every slot has a
+ *  sequence number telling whether it is ready to be written or read on
+ *  the current lap, producers and consumers claim slots with a CAS on
+ *  their own index and publish them with a release store of the
+ *  sequence. spsc_ptr_queue is the single producer, single consumer ring,
+ *  where each side caches the other's index and only reloads it when the
+ *  ring looks full or empty.
+ *
+ * Capacities are rounded up to a power of two. try_push leaves its
+ *  argument untouched when the queue is full. Pointers still queued are
+ *  released by the destructor.
+ *
+ * unique_ptrs are queued without their deleter, so their deleter type must
+ *  be empty and default constructible, as default_delete is.
+ */
+
+#ifndef PTR_QUEUE_HPP
+#define PTR_QUEUE_HPP 1
+
+#include <cstddef> // size_t
+#include <cstdint> // intptr_t
+#include <atomic> // atomic
+#include <type_traits> // is_empty, is_default_constructible
+
+#include "shared_ptr.hpp"
+#include "unique_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    namespace detail
+    {
+
+        // ptr_queue_traits
+        // Takes a pointer apart into the raw parts a queue slot stores and
+        // puts it back together, moving ownership with the parts.
+
+        template<typename P>
+        struct ptr_queue_traits; // only the library's smart pointers can be queued
+
+        template<typename T>
+        struct ptr_queue_traits<shared_ptr<T>>
+        {
+            struct raw_type
+            {
+                typename shared_ptr<T>::element_type *ptr;
+                control_block_base *control_block;
+            };
+
+            static raw_type
+            release(shared_ptr<T> &p) noexcept
+            {
+                raw_type r;
+                r.ptr = p.get();
+                r.control_block = shared_ptr_internals::release(p);
+                return r;
+            }
+
+            static shared_ptr<T>
+            adopt(const raw_type &r) noexcept
+            {
+                return shared_ptr_internals::adopt<T>(r.ptr, r.control_block);
+            }
+        };
+
+        template<typename T, typename D>
+        struct ptr_queue_traits<unique_ptr<T, D>>
+        {
+            static_assert(std::is_empty<D>::value && std::is_default_constructible<D>::value,
+                "queued unique_ptrs lose their deleter, it must be empty and default constructible");
+
+            using raw_type = typename unique_ptr<T, D>::pointer;
+
+            static raw_type
+            release(unique_ptr<T, D> &p) noexcept
+            {
+                return p.release();
+            }
+
+            static unique_ptr<T, D>
+            adopt(const raw_type &r) noexcept
+            {
+                return unique_ptr<T, D>{ r };
+            }
+        };
+
+        /// Rounds n up to a power of two, at least 2
+        inline std::size_t
+        ptr_queue_capacity(std::size_t n) noexcept
+        {
+            std::size_t c = 2;
+            while (c < n)
+                c <<= 1;
+            return c;
+        }
+
+        constexpr std::size_t ptr_queue_line = 64; // keeps producer and consumer indices apart
+
+    } // namespace detail
+
+    // mpmc_ptr_queue
+    // Bounded queue for any number of producers and consumers.
+
+    template<typename P>
+    class mpmc_ptr_queue
+    {
+        using _Traits = detail::ptr_queue_traits<P>;
+        using _Raw = typename _Traits::raw_type;
+
+    public:
+        using value_type = P;
+
+        /// Creates an empty queue holding at least capacity pointers
+        explicit mpmc_ptr_queue(std::size_t capacity)
+            :
+            _mask{ detail::ptr_queue_capacity(capacity) - 1 },
+            _cells{ new _Cell[_mask + 1] }
+        {
+            for (std::size_t i = 0; i <= _mask; ++i)
+                _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        /// Releases the pointers still queued
+        ~mpmc_ptr_queue()
+        {
+            P p;
+            while (try_pop(p))
+            {
+            }
+        }
+
+        mpmc_ptr_queue(const mpmc_ptr_queue &) = delete;
+        mpmc_ptr_queue &operator=(const mpmc_ptr_queue &) = delete;
+
+        /// Moves p into the queue, leaving p empty
+        /// Returns false, with p untouched, when the queue is full.
+        bool
+        try_push(P &&p) noexcept
+        {
+            _Cell *cell;
+            std::size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                cell = &_cells[pos & _mask];
+                std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+                std::intptr_t diff = std::intptr_t(seq) - std::intptr_t(pos);
+                if (diff == 0)
+                {
+                    if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false; // the slot still holds the pointer of the previous lap
+                else
+                    pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+            cell->raw = _Traits::release(p);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Moves the oldest pointer into p, whose previous value is released
+        /// Returns false, with p untouched, when the queue is empty.
+        bool
+        try_pop(P &p) noexcept
+        {
+            _Cell *cell;
+            std::size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                cell = &_cells[pos & _mask];
+                std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+                std::intptr_t diff = std::intptr_t(seq) - std::intptr_t(pos + 1);
+                if (diff == 0)
+                {
+                    if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false; // the slot has not been written on this lap
+                else
+                    pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+            _Raw raw = cell->raw;
+            cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+            p = _Traits::adopt(raw);
+            return true;
+        }
+
+        std::size_t
+        capacity() const noexcept
+        {
+            return _mask + 1;
+        }
+
+        /// Number of queued pointers, only a hint while other threads use the queue
+        std::size_t
+        size_approx() const noexcept
+        {
+            std::size_t tail = _enqueue_pos.load(std::memory_order_relaxed);
+            std::size_t head = _dequeue_pos.load(std::memory_order_relaxed);
+            return tail > head ? tail - head : 0;
+        }
+
+    private:
+        struct _Cell
+        {
+            std::atomic<std::size_t> sequence;
+            _Raw raw;
+        };
+
+        const std::size_t _mask;
+        unique_ptr<_Cell[]> _cells;
+        char _pad0[detail::ptr_queue_line];
+        std::atomic<std::size_t> _enqueue_pos{ 0 };
+        char _pad1[detail::ptr_queue_line];
+        std::atomic<std::size_t> _dequeue_pos{ 0 };
+        char _pad2[detail::ptr_queue_line];
+    };
+
+    // spsc_ptr_queue
+    // Bounded queue for one producer thread and one consumer thread.
+
+    template<typename P>
+    class spsc_ptr_queue
+    {
+        using _Traits = detail::ptr_queue_traits<P>;
+        using _Raw = typename _Traits::raw_type;
+
+    public:
+        using value_type = P;
+
+        /// Creates an empty queue holding at least capacity pointers
+        explicit spsc_ptr_queue(std::size_t capacity)
+            :
+            _mask{ detail::ptr_queue_capacity(capacity) - 1 },
+            _slots{ new _Raw[_mask + 1] }
+        {
+        }
+
+        /// Releases the pointers still queued
+        ~spsc_ptr_queue()
+        {
+            P p;
+            while (try_pop(p))
+            {
+            }
+        }
+
+        spsc_ptr_queue(const spsc_ptr_queue &) = delete;
+        spsc_ptr_queue &operator=(const spsc_ptr_queue &) = delete;
+
+        /// Moves p into the queue, leaving p empty, from the producer thread
+        /// Returns false, with p untouched, when the queue is full.
+        bool
+        try_push(P &&p) noexcept
+        {
+            std::size_t tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _cached_head > _mask)
+            {
+                _cached_head = _head.load(std::memory_order_acquire);
+                if (tail - _cached_head > _mask)
+                    return false;
+            }
+            _slots[tail & _mask] = _Traits::release(p);
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Moves the oldest pointer into p, whose previous value is released,
+        ///     from the consumer thread
+        /// Returns false, with p untouched, when the queue is empty.
+        bool
+        try_pop(P &p) noexcept
+        {
+            std::size_t head = _head.load(std::memory_order_relaxed);
+            if (head == _cached_tail)
+            {
+                _cached_tail = _tail.load(std::memory_order_acquire);
+                if (head == _cached_tail)
+                    return false;
+            }
+            _Raw raw = _slots[head & _mask];
+            _head.store(head + 1, std::memory_order_release);
+            p = _Traits::adopt(raw);
+            return true;
+        }
+
+        std::size_t
+        capacity() const noexcept
+        {
+            return _mask + 1;
+        }
+
+    private:
+        const std::size_t _mask;
+        unique_ptr<_Raw[]> _slots;
+        char _pad0[detail::ptr_queue_line];
+        std::atomic<std::size_t> _tail{ 0 }; // written by the producer
+        std::size_t _cached_head = 0; // producer's copy of _head
+        char _pad1[detail::ptr_queue_line];
+        std::atomic<std::size_t> _head{ 0 }; // written by the consumer
+        std::size_t _cached_tail = 0; // consumer's copy of _tail
+        char _pad2[detail::ptr_queue_line];
+    };
+
+} // namespace smart_ptr
+
+#endif
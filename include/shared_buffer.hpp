@@ -0,0 +1,277 @@
+// shared_buffer implementation
+
+/**
+ * shared_buffer is a read-only view of bytes kept alive by a shared_ptr:
+ *  a pointer, a length, and shared ownership of whatever holds the bytes.
+ *  slice(offset, len) returns a view of a sub-range that shares the same
+ *  owner through the aliasing constructor, so parsers can hand out pieces
+ *  of a buffer without copying them and without tracking its lifetime.
+ *
+ * map_file_shared(path) maps a file read-only and returns a shared_buffer
+ *  of its contents. The mapping is the owner: its deleter munmaps it when
+ *  the last view, slices included, goes away. advise() forwards access
+ *  pattern hints for the pages of a view to madvise, and is a no-op for
+ *  buffers that are not mappings.
+ *
+ * The bytes are unsigned char, std::byte being C++17. map_file_shared is
+ *  only available on POSIX systems.
+ */
+
+#ifndef SHARED_BUFFER_HPP
+#define SHARED_BUFFER_HPP 1
+
+#include <cassert> // assert
+#include <cstddef> // size_t
+#include <cstdint> // uintptr_t
+#include <string> // string
+#include <system_error> // system_error, generic_category
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno> // errno
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap, munmap, madvise
+#include <sys/stat.h> // fstat
+#include <unistd.h> // close, sysconf
+#define SMART_PTR_HAS_MMAP 1
+#endif
+
+#include "shared_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    /// Access pattern hints for shared_buffer::advise
+    enum class access_advice
+    {
+        normal,
+        sequential, // read ahead aggressively, drop pages behind
+        random, // no read ahead
+        willneed, // start reading the pages in now
+        dontneed, // the pages may be dropped, they are read again if touched
+    };
+
+    class shared_buffer
+    {
+    public:
+        using value_type = unsigned char;
+        using const_iterator = const unsigned char *;
+
+        /// Default constructor, creates an empty buffer
+        shared_buffer() noexcept = default;
+
+        /// Views size bytes at data, kept alive by data's owner
+        shared_buffer(shared_ptr<const unsigned char> data, std::size_t size) noexcept
+            :
+            _data{ std::move(data) },
+            _size{ size }
+        {
+        }
+
+        // Observers
+
+        const unsigned char *
+        data() const noexcept
+        {
+            return _data.get();
+        }
+
+        std::size_t
+        size() const noexcept
+        {
+            return _size;
+        }
+
+        bool
+        empty() const noexcept
+        {
+            return _size == 0;
+        }
+
+        const_iterator
+        begin() const noexcept
+        {
+            return data();
+        }
+
+        const_iterator
+        end() const noexcept
+        {
+            return data() + _size;
+        }
+
+        const unsigned char &
+        operator[](std::size_t i) const noexcept
+        {
+            assert(i < _size && "shared_buffer index out of range");
+            return data()[i];
+        }
+
+        /// Checks whether the bytes are a file mapping
+        bool
+        mapped() const noexcept
+        {
+            return _mapped;
+        }
+
+        /// Number of views sharing the owner of the bytes
+        long
+        use_count() const noexcept
+        {
+            return _data.use_count();
+        }
+
+        /// Shares the bytes as a shared_ptr to the first of them
+        const shared_ptr<const unsigned char> &
+        share() const noexcept
+        {
+            return _data;
+        }
+
+        // Slicing
+
+        /// Views len bytes from offset, clamped to the end of the buffer,
+        ///     sharing ownership without copying
+        /// Precondition: offset <= size().
+        shared_buffer
+        slice(std::size_t offset, std::size_t len = std::size_t(-1)) const noexcept
+        {
+            assert(offset <= _size && "slice offset out of range");
+            if (len > _size - offset)
+                len = _size - offset;
+            shared_buffer s{ shared_ptr<const unsigned char>{ _data, data() + offset }, len };
+            s._mapped = _mapped;
+            return s;
+        }
+
+        /// Drops the first n bytes of the view
+        void
+        remove_prefix(std::size_t n) noexcept
+        {
+            *this = slice(n);
+        }
+
+        /// Drops the last n bytes of the view
+        void
+        remove_suffix(std::size_t n) noexcept
+        {
+            assert(n <= _size && "remove_suffix out of range");
+            _size -= n;
+        }
+
+        // Hints
+
+        /// Tells the kernel how the pages of this view will be accessed,
+        ///     failures are ignored since these are only hints
+        void
+        advise(access_advice a) const noexcept
+        {
+#if defined(SMART_PTR_HAS_MMAP)
+            if (!_mapped || !_size)
+                return;
+            std::uintptr_t page = std::uintptr_t(::sysconf(_SC_PAGESIZE));
+            std::uintptr_t first = reinterpret_cast<std::uintptr_t>(data()) & ~(page - 1);
+            std::uintptr_t last = reinterpret_cast<std::uintptr_t>(data()) + _size;
+            (void)::madvise(reinterpret_cast<void *>(first), last - first, _madvise_flag(a));
+#else
+            (void)a;
+#endif
+        }
+
+    private:
+#if defined(SMART_PTR_HAS_MMAP)
+        friend shared_buffer map_file_shared(const std::string &path, access_advice advice);
+
+        static int
+        _madvise_flag(access_advice a) noexcept
+        {
+            switch (a)
+            {
+                case access_advice::sequential:
+                    return MADV_SEQUENTIAL;
+                case access_advice::random:
+                    return MADV_RANDOM;
+                case access_advice::willneed:
+                    return MADV_WILLNEED;
+                case access_advice::dontneed:
+                    return MADV_DONTNEED;
+                default:
+                    return MADV_NORMAL;
+            }
+        }
+#endif
+
+        shared_ptr<const unsigned char> _data;
+        std::size_t _size = 0;
+        bool _mapped = false;
+    };
+
+#if defined(SMART_PTR_HAS_MMAP)
+
+    namespace detail
+    {
+
+        // deleter of a file mapping
+
+        struct munmap_deleter
+        {
+            std::size_t length;
+
+            void
+            operator()(const unsigned char *p) const noexcept
+            {
+                ::munmap(const_cast<unsigned char *>(p), length);
+            }
+        };
+
+    } // namespace detail
+
+    /// Maps the file at path read-only and views its contents, the mapping
+    ///     is removed when the last view of it goes away
+    /// An empty file gives an empty buffer. Throws std::system_error if the
+    ///     file cannot be opened or mapped.
+    inline shared_buffer
+    map_file_shared(const std::string &path, access_advice advice = access_advice::sequential)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "fstat " + path);
+        }
+        std::size_t size = std::size_t(st.st_size);
+        if (size == 0)
+        {
+            ::close(fd);
+            return shared_buffer{};
+        }
+        void *p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        int err = errno;
+        ::close(fd); // the mapping keeps the file referenced
+        if (p == MAP_FAILED)
+            throw std::system_error(err, std::generic_category(), "mmap " + path);
+
+        shared_buffer buf;
+        try
+        {
+            buf._data = shared_ptr<const unsigned char>{ static_cast<const unsigned char *>(p), detail::munmap_deleter{ size } };
+        }
+        catch (...)
+        {
+            ::munmap(p, size);
+            throw;
+        }
+        buf._size = size;
+        buf._mapped = true;
+        buf.advise(advice);
+        return buf;
+    }
+
+#endif
+
+} // namespace smart_ptr
+
+#endif
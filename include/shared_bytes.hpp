@@ -0,0 +1,450 @@
+// shared_bytes implementation
+
+/**
+ * shared_bytes is a reference-counted byte buffer for I/O paths. Like
+ *  make_shared<unsigned char[]>(n), a buffer is one allocation holding
+ *  the control block followed by the bytes. slice(offset, len) returns a
+ *  view of a sub-range in O(1) through the aliasing constructor, sharing
+ *  the buffer instead of copying it.
+ *
+ * try_unique_mut() gives write access to the bytes of a view only while
+ *  it is the sole reference to the buffer, so a buffer received from a
+ *  socket can be patched in place when nobody else sees it.
+ *
+ * Buffers come from a bytes_pool. When the last view of a buffer goes
+ *  away its block returns to the free list of its size class, powers of
+ *  two from 64 bytes to 64 KiB, instead of going back to the allocator;
+ *  larger buffers are allocated and freed directly. Each class keeps at
+ *  most max_cached blocks, under a mutex of its own.
+ *
+ * A bytes_pool must outlive the buffers taken from it. The global() pool
+ *  is never destroyed, so buffers from it may outlive main().
+ */
+
+#ifndef SHARED_BYTES_HPP
+#define SHARED_BYTES_HPP 1
+
+#include <cassert> // assert
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <cstring> // memcpy
+#include <new> // placement new, bad_array_new_length
+#include <mutex> // mutex, lock_guard
+#include <atomic> // atomic
+
+#include "control_block.hpp"
+#include "shared_ptr.hpp"
+#include "shared_pool.hpp"
+#include "shared_buffer.hpp"
+
+namespace smart_ptr
+{
+
+    class bytes_pool;
+
+    namespace detail
+    {
+
+        // control block of a shared_bytes buffer, followed by its bytes
+        // Goes back to its pool when the last reference is released.
+
+        class control_block_bytes : public control_block_counted
+        {
+        public:
+            unsigned char *
+            data() noexcept
+            {
+                return reinterpret_cast<unsigned char *>(this) + offset();
+            }
+
+            std::size_t
+            capacity() const noexcept
+            {
+                return _capacity;
+            }
+
+            void *
+            get_deleter() noexcept override // shared_bytes has no deleter
+            {
+                return nullptr;
+            }
+
+            /// Offset of the bytes from the start of the block
+            static constexpr std::size_t
+            offset() noexcept
+            {
+                return (sizeof(control_block_bytes) + 15) & ~std::size_t(15);
+            }
+
+        private:
+            friend class smart_ptr::bytes_pool;
+
+            control_block_bytes(bytes_pool *pool, std::size_t capacity, std::size_t cls) noexcept
+                :
+                _pool{ pool },
+                _capacity{ capacity },
+                _class{ cls }
+            {
+            }
+
+            void
+            dispose() noexcept override // bytes need no destruction
+            {
+            }
+
+            inline void
+            destroy() noexcept override;
+
+            bytes_pool *_pool; // nullptr for unpooled sizes
+            std::size_t _capacity;
+            std::size_t _class;
+            control_block_bytes *_next = nullptr; // free list link
+        };
+
+    } // namespace detail
+
+    class bytes_pool
+    {
+    public:
+        static constexpr std::size_t min_class_bytes = 64;
+        static constexpr std::size_t max_class_bytes = 64 * 1024;
+        static constexpr std::size_t classes = 11; // 64 B to 64 KiB
+
+        /// Creates an empty pool that keeps at most max_cached released
+        ///     blocks per size class
+        explicit bytes_pool(std::size_t max_cached = 64) noexcept
+            :
+            _max_cached{ max_cached }
+        {
+        }
+
+        /// Frees the cached blocks
+        /// Precondition: no buffer taken from the pool is still referenced.
+        ~bytes_pool()
+        {
+            assert(_in_use.load() == 0 && "bytes_pool destroyed while buffers are in use");
+            trim();
+        }
+
+        bytes_pool(const bytes_pool &) = delete;
+        bytes_pool &operator=(const bytes_pool &) = delete;
+
+        /// Process-wide pool, never destroyed
+        static bytes_pool &
+        global()
+        {
+            static bytes_pool *pool = new bytes_pool{};
+            return *pool;
+        }
+
+        /// Frees every cached block
+        void
+        trim() noexcept
+        {
+            for (auto &c : _classes)
+            {
+                detail::control_block_bytes *b;
+                {
+                    std::lock_guard<std::mutex> lock{ c.mutex };
+                    b = c.head;
+                    c.head = nullptr;
+                    c.count = 0;
+                }
+                while (b)
+                {
+                    detail::control_block_bytes *next = b->_next;
+                    _free(b);
+                    b = next;
+                }
+            }
+        }
+
+        /// Counters of the pool, hits and misses only count pooled sizes
+        pool_stats
+        stats() const noexcept
+        {
+            pool_stats s;
+            s.hits = _hits.load(std::memory_order_relaxed);
+            s.misses = _misses.load(std::memory_order_relaxed);
+            s.recycled = _recycled.load(std::memory_order_relaxed);
+            s.in_use = _in_use.load(std::memory_order_relaxed);
+            return s;
+        }
+
+    private:
+        friend class detail::control_block_bytes;
+        friend class shared_bytes;
+
+        struct size_class
+        {
+            std::mutex mutex;
+            detail::control_block_bytes *head = nullptr;
+            std::size_t count = 0;
+        };
+
+        /// Size class of n bytes, classes when n is not pooled
+        static std::size_t
+        _class_of(std::size_t n) noexcept
+        {
+            if (n > max_class_bytes)
+                return classes;
+            std::size_t cls = 0;
+            while ((min_class_bytes << cls) < n)
+                ++cls;
+            return cls;
+        }
+
+        detail::control_block_bytes *
+        _acquire(std::size_t n)
+        {
+            std::size_t cls = _class_of(n);
+            if (cls < classes)
+            {
+                size_class &c = _classes[cls];
+                detail::control_block_bytes *b;
+                {
+                    std::lock_guard<std::mutex> lock{ c.mutex };
+                    b = c.head;
+                    if (b)
+                    {
+                        c.head = b->_next;
+                        --c.count;
+                    }
+                }
+                _in_use.fetch_add(1, std::memory_order_relaxed);
+                if (b)
+                {
+                    _hits.fetch_add(1, std::memory_order_relaxed);
+                    b->revive();
+                    return b;
+                }
+                _misses.fetch_add(1, std::memory_order_relaxed);
+                return _allocate(this, min_class_bytes << cls, cls);
+            }
+            return _allocate(nullptr, n, cls);
+        }
+
+        void
+        _recycle(detail::control_block_bytes *b) noexcept
+        {
+            _in_use.fetch_sub(1, std::memory_order_relaxed);
+            size_class &c = _classes[b->_class];
+            {
+                std::lock_guard<std::mutex> lock{ c.mutex };
+                if (c.count < _max_cached)
+                {
+                    b->_next = c.head;
+                    c.head = b;
+                    ++c.count;
+                    _recycled.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+            }
+            _free(b);
+        }
+
+        static detail::control_block_bytes *
+        _allocate(bytes_pool *pool, std::size_t capacity, std::size_t cls)
+        {
+            std::size_t offset = detail::control_block_bytes::offset();
+            if (capacity > std::size_t(-1) - offset)
+                throw std::bad_array_new_length{};
+            void *mem = detail::allocate_aligned(offset + capacity, 16);
+            return ::new (mem) detail::control_block_bytes{ pool, capacity, cls };
+        }
+
+        static void
+        _free(detail::control_block_bytes *b) noexcept
+        {
+            std::size_t size = detail::control_block_bytes::offset() + b->_capacity;
+            b->~control_block_bytes();
+            detail::deallocate_aligned(static_cast<void *>(b), size, 16);
+        }
+
+        std::size_t _max_cached;
+        size_class _classes[classes];
+
+        std::atomic<std::uint64_t> _hits{ 0 };
+        std::atomic<std::uint64_t> _misses{ 0 };
+        std::atomic<std::uint64_t> _recycled{ 0 };
+        std::atomic<std::uint64_t> _in_use{ 0 };
+    };
+
+    inline void
+    detail::control_block_bytes::destroy() noexcept
+    {
+        if (_pool)
+            _pool->_recycle(this);
+        else
+            bytes_pool::_free(this);
+    }
+
+    class shared_bytes
+    {
+    public:
+        using value_type = unsigned char;
+        using const_iterator = const unsigned char *;
+
+        /// Default constructor, creates an empty buffer
+        shared_bytes() noexcept = default;
+
+        /// Creates a buffer of n bytes from pool, left uninitialized to be
+        ///     filled through try_unique_mut(), by a read() for example
+        static shared_bytes
+        allocate(std::size_t n, bytes_pool &pool = bytes_pool::global())
+        {
+            detail::control_block_bytes *cb = pool._acquire(n);
+            return shared_bytes{ detail::shared_ptr_internals::adopt<const unsigned char>(cb->data(), cb), n };
+        }
+
+        /// Creates a buffer holding a copy of n bytes at p
+        static shared_bytes
+        copy_of(const void *p, std::size_t n, bytes_pool &pool = bytes_pool::global())
+        {
+            shared_bytes b = allocate(n, pool);
+            if (n)
+                std::memcpy(b.try_unique_mut(), p, n);
+            return b;
+        }
+
+        // Observers
+
+        const unsigned char *
+        data() const noexcept
+        {
+            return _data.get();
+        }
+
+        std::size_t
+        size() const noexcept
+        {
+            return _size;
+        }
+
+        bool
+        empty() const noexcept
+        {
+            return _size == 0;
+        }
+
+        const_iterator
+        begin() const noexcept
+        {
+            return data();
+        }
+
+        const_iterator
+        end() const noexcept
+        {
+            return data() + _size;
+        }
+
+        const unsigned char &
+        operator[](std::size_t i) const noexcept
+        {
+            assert(i < _size && "shared_bytes index out of range");
+            return data()[i];
+        }
+
+        /// Number of views sharing the buffer
+        long
+        use_count() const noexcept
+        {
+            return _data.use_count();
+        }
+
+        /// Gets write access to the bytes of this view if it is the only
+        ///     reference to the buffer, nullptr otherwise
+        /// The check has acquire semantics, as cow_ptr::write(): accesses
+        ///     through views released by other threads happen before.
+        unsigned char *
+        try_unique_mut() noexcept
+        {
+            detail::control_block_base *cb = detail::shared_ptr_internals::control_block(_data);
+            if (!cb || !cb->unique() || cb->weak_use_count() != 0)
+                return nullptr;
+            return const_cast<unsigned char *>(_data.get());
+        }
+
+        /// Shares the bytes as a shared_ptr to the first of them
+        const shared_ptr<const unsigned char> &
+        share() const noexcept
+        {
+            return _data;
+        }
+
+        /// Views the bytes as a read-only shared_buffer, sharing the buffer
+        shared_buffer
+        as_buffer() const noexcept
+        {
+            return shared_buffer{ _data, _size };
+        }
+
+        // Slicing
+
+        /// Views len bytes from offset, clamped to the end of the view,
+        ///     sharing the buffer without copying
+        /// Precondition: offset <= size().
+        shared_bytes
+        slice(std::size_t offset, std::size_t len = std::size_t(-1)) const noexcept
+        {
+            assert(offset <= _size && "slice offset out of range");
+            if (len > _size - offset)
+                len = _size - offset;
+            return shared_bytes{ shared_ptr<const unsigned char>{ _data, data() + offset }, len };
+        }
+
+        /// Drops the first n bytes of the view
+        void
+        remove_prefix(std::size_t n) noexcept
+        {
+            assert(n <= _size && "remove_prefix out of range");
+            _data = shared_ptr<const unsigned char>{ std::move(_data), data() + n };
+            _size -= n;
+        }
+
+        /// Drops the last n bytes of the view
+        void
+        remove_suffix(std::size_t n) noexcept
+        {
+            assert(n <= _size && "remove_suffix out of range");
+            _size -= n;
+        }
+
+        void
+        swap(shared_bytes &other) noexcept
+        {
+            _data.swap(other._data);
+            std::size_t s = _size;
+            _size = other._size;
+            other._size = s;
+        }
+
+        void
+        reset() noexcept
+        {
+            _data.reset();
+            _size = 0;
+        }
+
+    private:
+        shared_bytes(shared_ptr<const unsigned char> data, std::size_t size) noexcept
+            :
+            _data{ std::move(data) },
+            _size{ size }
+        {
+        }
+
+        shared_ptr<const unsigned char> _data;
+        std::size_t _size = 0;
+    };
+
+    inline void
+    swap(shared_bytes &a, shared_bytes &b) noexcept
+    {
+        a.swap(b);
+    }
+
+} // namespace smart_ptr
+
+#endif
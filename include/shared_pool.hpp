@@ -0,0 +1,441 @@
+// shared_pool implementation
+
+/**
+ * shared_pool<T> hands out shared_ptr<T>s to objects that are recycled
+ *  rather than destroyed. acquire() returns a shared_ptr to a pooled
+ *  object; when the last shared_ptr and weak_ptr to it are gone, the
+ *  object and its fused control block go back to the pool instead of
+ *  being deleted.
+ *
+ * Objects are default-constructed the first time their slot is used and
+ *  destroyed only with the pool. An optional reset hook runs on the
+ *  object when its last shared_ptr is released, so the next acquire()
+ *  gets it in a clean state.
+ *
+ * Released blocks first go to a small per-thread cache, then to a
+ *  lock-free free list shared by all threads. Blocks are allocated in
+ *  slabs that are never freed before the pool, which is what makes the
+ *  tagged-index free list safe against ABA.
+ *
+ * The pool must outlive every shared_ptr and weak_ptr acquired from it.
+ */
+
+#ifndef SHARED_POOL_HPP
+#define SHARED_POOL_HPP 1
+
+#include <cassert> // assert
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t, uint64_t
+#include <new> // placement new
+#include <mutex> // mutex, lock_guard
+#include <atomic> // atomic
+#include <vector> // vector
+#include <utility> // pair
+#include <functional> // function
+#include <type_traits> // aligned_storage
+
+#include "control_block.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    template<typename T>
+    class shared_pool;
+
+    /// Counters of a shared_pool, all monotonic except in_use
+    struct pool_stats
+    {
+        std::uint64_t hits; // acquire() served by a recycled object
+        std::uint64_t misses; // acquire() that had to construct an object
+        std::uint64_t recycled; // objects returned to the pool
+        std::uint64_t in_use; // objects currently acquired
+
+        double
+        hit_rate() const noexcept
+        {
+            return (hits + misses) ? double(hits) / double(hits + misses) : 0.0;
+        }
+    };
+
+    namespace detail
+    {
+
+        // fused control block of a pooled object
+        // Recycles itself into its pool instead of deleting.
+
+        template<typename T>
+        class control_block_pooled : public control_block_counted
+        {
+        public:
+            using element_type = T;
+
+            control_block_pooled(shared_pool<T> *pool, std::uint32_t index) noexcept
+                :
+                _pool{ pool },
+                _index{ index }
+            {
+            }
+
+            ~control_block_pooled()
+            {
+                if (_constructed)
+                    ptr()->~T();
+            }
+
+            T *
+            ptr() noexcept
+            {
+                return reinterpret_cast<T *>(&_storage);
+            }
+
+            void *
+            get_deleter() noexcept override // pooled objects have no deleter
+            {
+                return nullptr;
+            }
+
+        private:
+            friend class shared_pool<T>;
+
+            void
+            dispose() noexcept override
+            {
+                _pool->_reset(*ptr());
+            }
+
+            void
+            destroy() noexcept override
+            {
+                _pool->_recycle(this);
+            }
+
+            shared_pool<T> *_pool;
+            std::uint32_t _index;
+            std::atomic<std::uint32_t> _next{ 0 }; // free list link, index + 1
+            bool _constructed = false;
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+        };
+
+    } // namespace detail
+
+    template<typename T>
+    class shared_pool
+    {
+    public:
+        using element_type = T;
+        using reset_hook = std::function<void(T &)>;
+
+        static constexpr std::size_t max_thread_cache = 32;
+
+        /// Creates an empty pool
+        /// reset: called on an object when its last shared_ptr is released.
+        /// thread_cache: blocks kept per thread before the shared free list
+        ///     is used, at most max_thread_cache, 0 disables the cache.
+        explicit shared_pool(reset_hook reset = reset_hook{},
+            std::size_t thread_cache = 16) :
+            _reset_hook{ std::move(reset) },
+            _thread_cache{ thread_cache < max_thread_cache ? thread_cache : max_thread_cache },
+            _id{ _next_id().fetch_add(1) + 1 }
+        {
+            for (auto &slab : _slabs)
+                slab.store(nullptr, std::memory_order_relaxed);
+            _registry().add(_id, this);
+        }
+
+        /// Destroys every pooled object
+        /// Precondition: no object acquired from the pool is still referenced.
+        ~shared_pool()
+        {
+            _registry().remove(_id);
+            assert(_in_use.load() == 0 && "shared_pool destroyed while objects are in use");
+            for (std::uint32_t s = 0; s < max_slabs; ++s)
+            {
+                block *slab = _slabs[s].load();
+                if (!slab)
+                    break;
+                std::uint32_t n = _slab_size(s);
+                for (std::uint32_t i = 0; i < n; ++i)
+                    slab[i].~block();
+                detail::deallocate_aligned(static_cast<void *>(slab), sizeof(block) * n, alignof(block));
+            }
+        }
+
+        shared_pool(const shared_pool &) = delete;
+        shared_pool &operator=(const shared_pool &) = delete;
+
+        /// Returns a shared_ptr to a recycled object, or to a newly
+        ///     default-constructed one when the pool is empty
+        shared_ptr<T>
+        acquire()
+        {
+            block *b = _pop_local();
+            if (!b)
+                b = _pop_shared();
+            if (!b)
+                b = _grow();
+            if (b->_constructed)
+            {
+                _hits.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                _misses.fetch_add(1, std::memory_order_relaxed);
+                try
+                {
+                    ::new (static_cast<void *>(&b->_storage)) T{};
+                }
+                catch (...)
+                {
+                    _push_shared(b);
+                    throw;
+                }
+                b->_constructed = true;
+            }
+            b->revive();
+            _in_use.fetch_add(1, std::memory_order_relaxed);
+            return detail::shared_ptr_internals::adopt<T>(b->ptr(), b);
+        }
+
+        /// Current counters of the pool
+        pool_stats
+        stats() const noexcept
+        {
+            pool_stats s;
+            s.hits = _hits.load(std::memory_order_relaxed);
+            s.misses = _misses.load(std::memory_order_relaxed);
+            s.recycled = _recycled.load(std::memory_order_relaxed);
+            s.in_use = _in_use.load(std::memory_order_relaxed);
+            return s;
+        }
+
+    private:
+        friend class detail::control_block_pooled<T>;
+
+        using block = detail::control_block_pooled<T>;
+
+        static constexpr std::uint32_t first_slab = 64;
+        static constexpr std::uint32_t max_slabs = 26; // 64 * (2^26 - 1) slots
+
+        // per-thread stash of released blocks of one pool
+
+        struct thread_cache
+        {
+            std::uint64_t owner = 0;
+            std::size_t count = 0;
+            block *items[max_thread_cache];
+
+            ~thread_cache()
+            {
+                if (count)
+                    _registry().give_back(owner, items, count);
+            }
+        };
+
+        // live pools by id, lets exiting threads return cached blocks
+
+        class registry
+        {
+        public:
+            void
+            add(std::uint64_t id, shared_pool *pool)
+            {
+                std::lock_guard<std::mutex> lock{ _mutex };
+                _pools.emplace_back(id, pool);
+            }
+
+            void
+            remove(std::uint64_t id)
+            {
+                std::lock_guard<std::mutex> lock{ _mutex };
+                for (auto it = _pools.begin(); it != _pools.end(); ++it)
+                    if (it->first == id)
+                    {
+                        _pools.erase(it);
+                        return;
+                    }
+            }
+
+            void
+            give_back(std::uint64_t id, block **items, std::size_t n)
+            {
+                std::lock_guard<std::mutex> lock{ _mutex };
+                for (auto &entry : _pools)
+                    if (entry.first == id)
+                    {
+                        for (std::size_t i = 0; i < n; ++i)
+                            entry.second->_push_shared(items[i]);
+                        return;
+                    }
+            }
+
+        private:
+            std::mutex _mutex;
+            std::vector<std::pair<std::uint64_t, shared_pool *>> _pools;
+        };
+
+        static registry &
+        _registry()
+        {
+            static registry r;
+            return r;
+        }
+
+        static std::atomic<std::uint64_t> &
+        _next_id()
+        {
+            static std::atomic<std::uint64_t> id{ 0 };
+            return id;
+        }
+
+        static thread_cache &
+        _cache()
+        {
+            static thread_local thread_cache cache;
+            return cache;
+        }
+
+        static std::uint32_t
+        _slab_size(std::uint32_t s) noexcept
+        {
+            return first_slab << s;
+        }
+
+        block *
+        _block_at(std::uint32_t index) const noexcept
+        {
+            // slab s holds the indices [first_slab * (2^s - 1), first_slab * (2^(s+1) - 1))
+            std::uint32_t q = index / first_slab + 1;
+            std::uint32_t s = 0;
+            while (q >>= 1)
+                ++s;
+            return _slabs[s].load(std::memory_order_acquire)
+                + (index - first_slab * ((std::uint32_t{ 1 } << s) - 1));
+        }
+
+        void
+        _reset(T &obj) noexcept
+        {
+            if (_reset_hook)
+                _reset_hook(obj);
+        }
+
+        void
+        _recycle(block *b)
+        {
+            _in_use.fetch_sub(1, std::memory_order_relaxed);
+            _recycled.fetch_add(1, std::memory_order_relaxed);
+            if (!_push_local(b))
+                _push_shared(b);
+        }
+
+        block *
+        _pop_local() noexcept
+        {
+            thread_cache &c = _cache();
+            if (c.owner != _id || c.count == 0)
+                return nullptr;
+            return c.items[--c.count];
+        }
+
+        bool
+        _push_local(block *b)
+        {
+            thread_cache &c = _cache();
+            if (c.owner != _id && c.count != 0)
+            {
+                // the cache follows the pool this thread released to last
+                _registry().give_back(c.owner, c.items, c.count);
+                c.count = 0;
+            }
+            c.owner = _id;
+            if (c.count >= _thread_cache)
+                return false;
+            c.items[c.count++] = b;
+            return true;
+        }
+
+        // Treiber stack of block indices, the high half of _head is a tag
+        // bumped by every successful update
+
+        block *
+        _pop_shared() noexcept
+        {
+            std::uint64_t head = _head.load(std::memory_order_acquire);
+            for (;;)
+            {
+                std::uint32_t top = static_cast<std::uint32_t>(head);
+                if (top == 0)
+                    return nullptr;
+                block *b = _block_at(top - 1);
+                std::uint32_t next = b->_next.load(std::memory_order_relaxed);
+                std::uint64_t tag = (head >> 32) + 1;
+                if (_head.compare_exchange_weak(head, (tag << 32) | next,
+                        std::memory_order_acquire, std::memory_order_acquire))
+                    return b;
+            }
+        }
+
+        void
+        _push_shared(block *b) noexcept
+        {
+            std::uint64_t head = _head.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                b->_next.store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+                std::uint64_t tag = (head >> 32) + 1;
+                if (_head.compare_exchange_weak(head, (tag << 32) | (b->_index + 1),
+                        std::memory_order_release, std::memory_order_relaxed))
+                    return;
+            }
+        }
+
+        // Allocates the next slab, keeps one block and frees the rest
+        block *
+        _grow()
+        {
+            std::lock_guard<std::mutex> lock{ _grow_mutex };
+            if (block *b = _pop_shared()) // another thread may have grown meanwhile
+                return b;
+            std::uint32_t s = _slab_count;
+            if (s == max_slabs)
+                throw std::bad_alloc{};
+            std::uint32_t n = _slab_size(s);
+            std::uint32_t first = first_slab * ((std::uint32_t{ 1 } << s) - 1);
+            block *slab = static_cast<block *>(detail::allocate_aligned(sizeof(block) * n, alignof(block)));
+            for (std::uint32_t i = 0; i < n; ++i)
+                ::new (static_cast<void *>(slab + i)) block{ this, first + i };
+            _slabs[s].store(slab, std::memory_order_release);
+            ++_slab_count;
+            for (std::uint32_t i = n - 1; i > 0; --i)
+                _push_shared(slab + i);
+            return slab;
+        }
+
+        reset_hook _reset_hook;
+        std::size_t _thread_cache;
+        std::uint64_t _id;
+
+        std::atomic<std::uint64_t> _head{ 0 };
+        std::atomic<block *> _slabs[max_slabs];
+        std::uint32_t _slab_count = 0;
+        std::mutex _grow_mutex;
+
+        std::atomic<std::uint64_t> _hits{ 0 };
+        std::atomic<std::uint64_t> _misses{ 0 };
+        std::atomic<std::uint64_t> _recycled{ 0 };
+        std::atomic<std::uint64_t> _in_use{ 0 };
+    };
+
+    template<typename T>
+    constexpr std::size_t shared_pool<T>::max_thread_cache;
+
+    template<typename T>
+    constexpr std::uint32_t shared_pool<T>::first_slab;
+
+    template<typename T>
+    constexpr std::uint32_t shared_pool<T>::max_slabs;
+
+} // namespace smart_ptr
+
+#endif
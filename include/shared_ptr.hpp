@@ -4,9 +4,10 @@
 #define SHARED_PTR_HPP 1
 
 #include <cstddef> /// nullptr_t, size_t, ptrdiff_t
+#include <cassert> /// assert
 #include <utility> /// move, forward, swap
 #include <functional> /// less, hash
-#include <type_traits> /// extent, remove_extent, is_array, is_void
+#include <type_traits> /// extent, remove_extent, is_array, is_void, conditional
 /// common_type
 
 #include "control_block.hpp"
@@ -25,6 +26,11 @@ namespace smart_ptr
     template<typename T>
     class weak_ptr;
 
+    namespace detail
+    {
+        struct shared_ptr_internals;
+    } // namespace detail
+
     // shared_ptr_access general template
     // Defines operator*, operator-> and operator[]
     // for T not array or cv void
@@ -71,11 +77,11 @@ namespace smart_ptr
         using element_type = typename std::remove_extent<T>::type;
 
         /// Index operator, dereferencing operators are not provided
-        element_type *
-        operator[](ptrdiff_t i) const noexcept
+        element_type &
+        operator[](std::ptrdiff_t i) const noexcept
         {
             assert(_get() != nullptr);
-            static_assert(!std::extent<T>::value || i < std::extent<T>::value);
+            assert(i >= 0 && (!std::extent<T>::value || i < std::ptrdiff_t(std::extent<T>::value)));
             return _get()[i];
         }
 
@@ -136,9 +142,18 @@ namespace smart_ptr
         template<typename D, typename U>
         friend D *get_deleter(const shared_ptr<U> &) noexcept;
 
+        friend struct detail::shared_ptr_internals;
+
         using element_type = typename shared_ptr_access<T>::element_type;
         using weak_type = weak_ptr<T>; /* added in C++17 */
 
+    private:
+        template<typename U>
+        using _Default_deleter = typename std::conditional<std::is_array<T>::value,
+            default_delete<U[]>, default_delete<U>>::type;
+
+    public:
+
         // 20.7.2.2.1, constructors
 
         /// Default constructor, creates a shared_ptr with no managed object
@@ -159,12 +174,13 @@ namespace smart_ptr
         {
         }
 
-        /// Constructs a shared_ptr with p as the pointer to the managed object
+        /// Constructs a shared_ptr with p as the pointer to the managed object,
+        ///     deleted with delete[] for array types
         /// Postconditions: use_count() == 1 && get() == p.
         template<typename U>
         explicit shared_ptr(U *p) :
             _ptr{ p },
-            _control_block{ new detail::control_block<U>{ p } }
+            _control_block{ new detail::control_block<U, _Default_deleter<U>>{ p } }
         {
         }
 
@@ -213,6 +229,20 @@ namespace smart_ptr
                 _control_block->inc_ref();
         }
 
+        /* added in C++20 */
+        /// Aliasing move constructor: constructs a shared_ptr instance that
+        ///     stores p and takes over the ownership of sp
+        /// Postconditions: get() == p, sp is empty.
+        template<typename U>
+        shared_ptr(shared_ptr<U> &&sp, T *p) noexcept
+            :
+            _ptr{ p },
+            _control_block{ sp._control_block }
+        {
+            sp._ptr = nullptr;
+            sp._control_block = nullptr;
+        }
+
         /// Copy constructor: shares ownership of the object managed by sp
         /// Postconditions: use_count() == sp.use_count() && get() == sp.get().
         shared_ptr(const shared_ptr &sp) noexcept
@@ -268,13 +298,11 @@ namespace smart_ptr
             _ptr{ wp._ptr },
             _control_block{ wp._control_block }
         {
-            if (wp.expired())
+            if (!_control_block || !_control_block->try_inc_ref())
             {
                 assert(!"Bad weak_ptr!");
-            }
-            else
-            {
-                _control_block->inc_ref();
+                _ptr = nullptr;
+                _control_block = nullptr;
             }
         }
 
@@ -438,19 +466,211 @@ namespace smart_ptr
             return std::less<detail::control_block_base *>()(_control_block, wp._control_block);
         }
 
+        /// Hash of the owner, consistent with owner_equal
+        /// Implemented by mixing the address of control_block
+        std::size_t owner_hash() const noexcept
+        {
+            return detail::owner_hash_of(_control_block);
+        }
+
+        /// Checks whether this shared_ptr and other share ownership or are both empty
+        /// Implemented by comparing the address of control_block
+        template<typename U>
+        bool owner_equal(shared_ptr<U> const &sp) const noexcept
+        {
+            return _control_block == sp._control_block;
+        }
+
+        /// Checks whether this shared_ptr and other share ownership or are both empty
+        /// Implemented by comparing the address of control_block
+        template<class U>
+        bool owner_equal(weak_ptr<U> const &wp) const noexcept
+        {
+            return _control_block == wp._control_block;
+        }
+
     private:
+        /// Adopts a control block whose use_count already accounts for *this
+        shared_ptr(element_type *p, detail::control_block_base *cb,
+            detail::adopt_control_block_t) noexcept
+            :
+            _ptr{ p },
+            _control_block{ cb }
+        {
+        }
+
         element_type *_ptr;
         detail::control_block_base *_control_block;
     };
 
+    namespace detail
+    {
+
+        // Access to shared_ptr internals for the factories and the
+        // extensions built on top of shared_ptr
+
+        struct shared_ptr_internals
+        {
+            /// Builds a shared_ptr that adopts one reference of cb
+            template<typename T>
+            static shared_ptr<T>
+            adopt(typename shared_ptr<T>::element_type *p, control_block_base *cb) noexcept
+            {
+                return shared_ptr<T>{ p, cb, adopt_control_block_t{} };
+            }
+
+            template<typename T>
+            static control_block_base *
+            control_block(const shared_ptr<T> &sp) noexcept
+            {
+                return sp._control_block;
+            }
+
+            /// Empties sp without releasing its reference, which goes to
+            ///     the caller to be handed back through adopt()
+            template<typename T>
+            static control_block_base *
+            release(shared_ptr<T> &sp) noexcept
+            {
+                control_block_base *cb = sp._control_block;
+                sp._ptr = nullptr;
+                sp._control_block = nullptr;
+                return cb;
+            }
+
+            template<typename T>
+            static control_block_base *
+            control_block(const weak_ptr<T> &wp) noexcept
+            {
+                return wp._control_block;
+            }
+        };
+
+    } // namespace detail
+
     // 20.7.2.2.6, shared_ptr creation
 
+    template<typename T>
+    struct _Shared_if
+    {
+        using _Single_object = shared_ptr<T>;
+    };
+
+    template<typename T>
+    struct _Shared_if<T[]>
+    {
+        using _Unknown_bound = shared_ptr<T[]>;
+    };
+
+    template<typename T, std::size_t N>
+    struct _Shared_if<T[N]>
+    {
+        using _Known_bound = shared_ptr<T[N]>;
+    };
+
     /// Creates a shared_ptr that manages a new object
+    /// The object and its control block share a single allocation.
     template<typename T, typename... Args>
-    inline shared_ptr<T>
+    inline typename _Shared_if<T>::_Single_object
     make_shared(Args &&...args)
     {
-        return shared_ptr<T>{ new T{ std::forward<Args>(args)... } };
+        auto *cb = new detail::control_block_inplace<T>{ std::forward<Args>(args)... };
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+    /* added in C++20 */
+    // make_shared for arrays: the element count, the counts and the
+    // elements share a single allocation
+
+    /// Only for array types with unknown bound, value-initializes n elements
+    template<typename T>
+    inline typename _Shared_if<T>::_Unknown_bound
+    make_shared(std::size_t n)
+    {
+        using U = typename std::remove_extent<T>::type;
+        auto *cb = detail::control_block_array<U>::create(n, detail::value_init_element<U>{});
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+    /// Only for array types with unknown bound, copies init into n elements
+    template<typename T>
+    inline typename _Shared_if<T>::_Unknown_bound
+    make_shared(std::size_t n, const typename std::remove_extent<T>::type &init)
+    {
+        using U = typename std::remove_extent<T>::type;
+        auto *cb = detail::control_block_array<U>::create(n, detail::copy_init_element<U>{ init });
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+    /// Only for array types with known bound, value-initializes the elements
+    template<typename T>
+    inline typename _Shared_if<T>::_Known_bound
+    make_shared()
+    {
+        using U = typename std::remove_extent<T>::type;
+        auto *cb = detail::control_block_array<U>::create(std::extent<T>::value, detail::value_init_element<U>{});
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+    /// Only for array types with known bound, copies init into the elements
+    template<typename T>
+    inline typename _Shared_if<T>::_Known_bound
+    make_shared(const typename std::remove_extent<T>::type &init)
+    {
+        using U = typename std::remove_extent<T>::type;
+        auto *cb = detail::control_block_array<U>::create(std::extent<T>::value, detail::copy_init_element<U>{ init });
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+    // make_shared_aligned: as make_shared<T[]>(n), with the elements
+    // starting on an alignment boundary chosen at runtime, past the
+    // control block header of the same allocation
+
+    /// Only for array types with unknown bound, value-initializes n elements
+    ///     aligned to align, a power of two, at least alignof(T)
+    /// Throws std::invalid_argument if align is not a power of two.
+    template<typename T>
+    inline typename _Shared_if<T>::_Unknown_bound
+    make_shared_aligned(std::size_t n, std::size_t align)
+    {
+        detail::check_alignment(align);
+        using U = typename std::remove_extent<T>::type;
+        auto *cb = detail::control_block_array<U>::create(n, detail::value_init_element<U>{}, align);
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+    /* added in C++20 */
+    // make_shared_for_overwrite: as make_shared, but default-initializes,
+    // so trivial types and arrays of them are left uninitialized
+
+    /// Only for non-array types
+    template<typename T>
+    inline typename _Shared_if<T>::_Single_object
+    make_shared_for_overwrite()
+    {
+        auto *cb = new detail::control_block_inplace<T>{ detail::for_overwrite_t{} };
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+    /// Only for array types with unknown bound
+    /// The n elements and the control block share a single allocation.
+    template<typename T>
+    inline typename _Shared_if<T>::_Unknown_bound
+    make_shared_for_overwrite(std::size_t n)
+    {
+        using U = typename std::remove_extent<T>::type;
+        auto *cb = detail::control_block_array<U>::create(n, detail::default_init_element<U>{});
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
+    }
+
+    /// Only for array types with known bound
+    template<typename T>
+    inline typename _Shared_if<T>::_Known_bound
+    make_shared_for_overwrite()
+    {
+        using U = typename std::remove_extent<T>::type;
+        auto *cb = detail::control_block_array<U>::create(std::extent<T>::value, detail::default_init_element<U>{});
+        return detail::shared_ptr_internals::adopt<T>(cb->ptr(), cb);
     }
 
     template<typename T, typename A, typename... Args>
@@ -0,0 +1,392 @@
+// slot_map and handle implementation
+
+/**
+ * slot_map<T> stores values in one contiguous array and hands out
+ *  handle<T>s to them: 64-bit values made of a slot index and a
+ *  generation. A handle is a non-owning reference like a weak_ptr, but
+ *  there is no control block: get(h) is two array accesses, and a handle
+ *  to an erased value is detected by comparing generations, since erasing
+ *  bumps the generation of the slot.
+ *
+ * Values are packed: erase moves the last value into the hole, so
+ *  iterating over begin()/end() walks a dense array. The slots keep the
+ *  position of their value and the values keep their slot, so handles
+ *  survive the move. Pointers and iterators to values do not, they are
+ *  invalidated by insertions and erasures like those of a vector.
+ *
+ * share(h) and extract(h) copy or move a value out into a shared_ptr, and
+ *  insert_shared(sp) takes one in, for the boundary with code that owns
+ *  objects through shared_ptr.
+ *
+ * A slot's generation is odd while it holds a value and even while it is
+ *  free, so the default handle, of generation 0, is never valid and no
+ *  handle matches a free slot. Generations are 32-bit: a stale handle
+ *  could only be mistaken for a newer value after its slot has been
+ *  reused 2^31 times.
+ */
+
+#ifndef SLOT_MAP_HPP
+#define SLOT_MAP_HPP 1
+
+#include <cassert> // assert
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t, uint64_t
+#include <functional> // hash
+#include <stdexcept> // length_error
+#include <utility> // forward, move
+#include <vector> // vector
+
+#include "shared_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    template<typename T>
+    class slot_map;
+
+    // handle
+    // Generational reference to a value of a slot_map<T>.
+
+    template<typename T>
+    class handle
+    {
+    public:
+        /// Default constructor, creates a null handle that refers to nothing
+        constexpr handle() noexcept = default;
+
+        std::uint32_t
+        index() const noexcept
+        {
+            return _index;
+        }
+
+        std::uint32_t
+        generation() const noexcept
+        {
+            return _generation;
+        }
+
+        /// Packs the handle into 64 bits, generation in the high half
+        std::uint64_t
+        bits() const noexcept
+        {
+            return (std::uint64_t(_generation) << 32) | _index;
+        }
+
+        /// Unpacks a handle packed by bits()
+        static handle
+        from_bits(std::uint64_t b) noexcept
+        {
+            return handle{ std::uint32_t(b), std::uint32_t(b >> 32) };
+        }
+
+        /// Checks whether the handle is not null, not whether its value
+        ///     still exists, that is slot_map::contains()
+        explicit operator bool() const noexcept
+        {
+            return _generation != 0;
+        }
+
+        friend bool
+        operator==(handle a, handle b) noexcept
+        {
+            return a._index == b._index && a._generation == b._generation;
+        }
+
+        friend bool
+        operator!=(handle a, handle b) noexcept
+        {
+            return !(a == b);
+        }
+
+        friend bool
+        operator<(handle a, handle b) noexcept
+        {
+            return a.bits() < b.bits();
+        }
+
+    private:
+        friend class slot_map<T>;
+
+        constexpr handle(std::uint32_t index, std::uint32_t generation) noexcept
+            :
+            _index{ index },
+            _generation{ generation }
+        {
+        }
+
+        std::uint32_t _index = 0;
+        std::uint32_t _generation = 0;
+    };
+
+    // slot_map
+
+    template<typename T>
+    class slot_map
+    {
+    public:
+        using value_type = T;
+        using handle_type = handle<T>;
+        using iterator = typename std::vector<T>::iterator;
+        using const_iterator = typename std::vector<T>::const_iterator;
+
+        /// Default constructor, creates an empty slot_map
+        slot_map() = default;
+
+        // Modifiers
+
+        /// Constructs a value in place and returns its handle
+        /// Strong exception guarantee.
+        template<typename... Args>
+        handle_type
+        emplace(Args &&... args)
+        {
+            if (_free_head == _npos)
+            {
+                if (_slots.size() >= _npos)
+                    throw std::length_error{ "slot_map has no free slot index" };
+                _slots.push_back(_Slot{ 0, _npos });
+                _free_head = std::uint32_t(_slots.size() - 1);
+            }
+            _dense_to_slot.push_back(_free_head);
+            try
+            {
+                _values.emplace_back(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                _dense_to_slot.pop_back();
+                throw;
+            }
+            std::uint32_t index = _free_head;
+            _Slot &s = _slots[index];
+            _free_head = s.link;
+            s.link = std::uint32_t(_values.size() - 1);
+            ++s.generation;
+            return handle_type{ index, s.generation };
+        }
+
+        handle_type
+        insert(const T &value)
+        {
+            return emplace(value);
+        }
+
+        handle_type
+        insert(T &&value)
+        {
+            return emplace(std::move(value));
+        }
+
+        /// Inserts the value owned by sp, moved out of it if sp is its only
+        ///     owner, copied otherwise
+        /// Precondition: sp is not empty. A derived object is sliced.
+        handle_type
+        insert_shared(shared_ptr<T> sp)
+        {
+            assert(sp && "insert_shared() of an empty shared_ptr");
+            detail::control_block_base *cb = detail::shared_ptr_internals::control_block(sp);
+            if (cb->unique() && cb->weak_use_count() == 0)
+                return emplace(std::move(*sp));
+            return emplace(static_cast<const T &>(*sp));
+        }
+
+        /// Destroys the value of h, whose handles all become stale
+        /// Returns false if h was already stale.
+        bool
+        erase(handle_type h)
+        {
+            if (!contains(h))
+                return false;
+            _Slot &s = _slots[h._index];
+            std::uint32_t hole = s.link;
+            std::uint32_t last = std::uint32_t(_values.size() - 1);
+            if (hole != last)
+            {
+                _values[hole] = std::move(_values[last]);
+                _dense_to_slot[hole] = _dense_to_slot[last];
+                _slots[_dense_to_slot[hole]].link = hole;
+            }
+            _values.pop_back();
+            _dense_to_slot.pop_back();
+            _release(h._index);
+            return true;
+        }
+
+        /// Destroys every value, all handles become stale
+        void
+        clear() noexcept
+        {
+            for (std::uint32_t index : _dense_to_slot)
+                _release(index);
+            _values.clear();
+            _dense_to_slot.clear();
+        }
+
+        /// Reserves room for n values without reallocation
+        void
+        reserve(std::size_t n)
+        {
+            _values.reserve(n);
+            _dense_to_slot.reserve(n);
+            _slots.reserve(n);
+        }
+
+        // Lookup
+
+        /// Checks whether the value of h still exists
+        /// A free slot has an even generation, which a handle to it matches
+        ///     after an emplace that threw or a wrap of the generation.
+        bool
+        contains(handle_type h) const noexcept
+        {
+            return (h._generation & 1) != 0 && h._index < _slots.size()
+                && _slots[h._index].generation == h._generation;
+        }
+
+        /// Gets the value of h, nullptr if h is stale
+        T *
+        get(handle_type h) noexcept
+        {
+            return contains(h) ? &_values[_slots[h._index].link] : nullptr;
+        }
+
+        const T *
+        get(handle_type h) const noexcept
+        {
+            return contains(h) ? &_values[_slots[h._index].link] : nullptr;
+        }
+
+        /// Handle of the value at position i of the dense array
+        /// Precondition: i < size().
+        handle_type
+        handle_at(std::size_t i) const noexcept
+        {
+            assert(i < _values.size() && "handle_at() out of range");
+            std::uint32_t index = _dense_to_slot[i];
+            return handle_type{ index, _slots[index].generation };
+        }
+
+        // Conversions to shared_ptr
+
+        /// Copies the value of h into a new shared object, an empty
+        ///     shared_ptr if h is stale
+        shared_ptr<T>
+        share(handle_type h) const
+        {
+            const T *p = get(h);
+            return p ? smart_ptr::make_shared<T>(*p) : shared_ptr<T>{};
+        }
+
+        /// Moves the value of h into a new shared object and erases it, an
+        ///     empty shared_ptr if h is stale
+        shared_ptr<T>
+        extract(handle_type h)
+        {
+            T *p = get(h);
+            if (!p)
+                return shared_ptr<T>{};
+            shared_ptr<T> sp = smart_ptr::make_shared<T>(std::move(*p));
+            erase(h);
+            return sp;
+        }
+
+        // Iteration over the dense array
+
+        std::size_t
+        size() const noexcept
+        {
+            return _values.size();
+        }
+
+        bool
+        empty() const noexcept
+        {
+            return _values.empty();
+        }
+
+        T *
+        data() noexcept
+        {
+            return _values.data();
+        }
+
+        const T *
+        data() const noexcept
+        {
+            return _values.data();
+        }
+
+        iterator
+        begin() noexcept
+        {
+            return _values.begin();
+        }
+
+        iterator
+        end() noexcept
+        {
+            return _values.end();
+        }
+
+        const_iterator
+        begin() const noexcept
+        {
+            return _values.begin();
+        }
+
+        const_iterator
+        end() const noexcept
+        {
+            return _values.end();
+        }
+
+    private:
+        static constexpr std::uint32_t _npos = std::uint32_t(-1);
+
+        struct _Slot
+        {
+            std::uint32_t generation; // odd while live
+            std::uint32_t link; // position of the value if live, next free slot otherwise
+        };
+
+        /// Makes the handles of a slot stale and puts it on the free list
+        void
+        _release(std::uint32_t index) noexcept
+        {
+            _Slot &s = _slots[index];
+            ++s.generation;
+            s.link = _free_head;
+            _free_head = index;
+        }
+
+        std::vector<T> _values;
+        std::vector<std::uint32_t> _dense_to_slot; // slot of each value
+        std::vector<_Slot> _slots;
+        std::uint32_t _free_head = _npos;
+    };
+
+    template<typename T>
+    constexpr std::uint32_t slot_map<T>::_npos;
+
+} // namespace smart_ptr
+
+namespace std
+{
+
+    template<typename T>
+    struct hash<smart_ptr::handle<T>>
+    {
+        using result_type = std::size_t;
+        using argument_type = smart_ptr::handle<T>;
+
+        std::size_t
+        operator()(smart_ptr::handle<T> h) const noexcept
+        {
+            return std::hash<std::uint64_t>{}(h.bits());
+        }
+    };
+
+} // namespace std
+
+#endif
@@ -0,0 +1,433 @@
+// strong_ptr implementation
+
+/**
+ * strong_ptr<T> is a shared_ptr without weak references, for hot objects
+ *  such as messages that nobody observes weakly. make_strong<T>(args...)
+ *  allocates the object behind a header holding a single atomic count and
+ *  the function that destroys and frees the allocation. Copying is one
+ *  increment, releasing one decrement, followed for the last owner by a
+ *  direct call to the destroy function: no second count, no virtual calls.
+ *
+ * The header is two words, 16 bytes on LP64: the count and the destroy
+ *  function pointer, which takes a whole word by itself. A make_shared
+ *  control block has three: its vptr and two counts.
+ *
+ * strong_ptr and shared_ptr do not convert implicitly. to_shared_ptr()
+ *  and to_strong_ptr() convert explicitly, each by allocating a block of
+ *  the other kind that keeps the original owner alive, so the object is
+ *  released once both sides have let go of it.
+ *
+ * Arrays are not supported.
+ */
+
+#ifndef STRONG_PTR_HPP
+#define STRONG_PTR_HPP 1
+
+#include <cassert> // assert
+#include <cstddef> // size_t, nullptr_t
+#include <atomic> // atomic
+#include <functional> // hash
+#include <new> // placement new
+#include <type_traits> // aligned_storage, is_array, is_convertible, enable_if
+#include <utility> // forward, move
+
+#include "aligned_new.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    template<typename T>
+    class strong_ptr;
+
+    namespace detail
+    {
+
+        // header of every strong_ptr allocation
+
+        struct strong_header
+        {
+            std::atomic<long> count;
+            void (*destroy)(strong_header *) noexcept; // destroys the object and frees the allocation
+        };
+
+        // allocation of make_strong: the header, then the object
+
+        template<typename T>
+        struct strong_block : aligned_new<alignof(T)>
+        {
+            template<typename... Args>
+            explicit strong_block(Args &&...args)
+                :
+                header{ { 1 }, &strong_block::_destroy }
+            {
+                ::new (static_cast<void *>(&storage)) T{ std::forward<Args>(args)... };
+            }
+
+            T *
+            ptr() noexcept
+            {
+                return reinterpret_cast<T *>(&storage);
+            }
+
+            strong_header header; // first, so a header pointer is a block pointer
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        private:
+            static void
+            _destroy(strong_header *h) noexcept
+            {
+                strong_block *b = reinterpret_cast<strong_block *>(h);
+                b->ptr()->~T();
+                delete b;
+            }
+        };
+
+        // allocation of to_strong_ptr: the header and the shared_ptr it keeps
+
+        template<typename T>
+        struct strong_from_shared_block
+        {
+            explicit strong_from_shared_block(shared_ptr<T> sp) noexcept
+                :
+                header{ { 1 }, &strong_from_shared_block::_destroy },
+                owner{ std::move(sp) }
+            {
+            }
+
+            strong_header header; // first, so a header pointer is a block pointer
+            shared_ptr<T> owner;
+
+        private:
+            static void
+            _destroy(strong_header *h) noexcept
+            {
+                delete reinterpret_cast<strong_from_shared_block *>(h);
+            }
+        };
+
+        // deleter of the shared_ptrs made by to_shared_ptr, owning a reference
+        // of the strong_ptr
+
+        template<typename T>
+        struct strong_ptr_owner
+        {
+            strong_ptr<T> owner;
+
+            void
+            operator()(T *) noexcept
+            {
+                owner.reset();
+            }
+        };
+
+    } // namespace detail
+
+    template<typename T>
+    class strong_ptr
+    {
+        static_assert(!std::is_array<T>::value, "strong_ptr does not support arrays");
+
+    public:
+        using element_type = T;
+
+        // Constructors
+
+        /// Default constructor, creates an empty strong_ptr
+        constexpr strong_ptr() noexcept = default;
+
+        /// Constructs with nullptr, creates an empty strong_ptr
+        constexpr strong_ptr(std::nullptr_t) noexcept
+        {
+        }
+
+        /// Copy constructor: shares ownership of the object managed by sp
+        strong_ptr(const strong_ptr &sp) noexcept
+            :
+            _ptr{ sp._ptr },
+            _header{ sp._header }
+        {
+            _inc();
+        }
+
+        /// Converting copy constructor, for U * convertible to T *
+        template<typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+        strong_ptr(const strong_ptr<U> &sp) noexcept
+            :
+            _ptr{ sp._ptr },
+            _header{ sp._header }
+        {
+            _inc();
+        }
+
+        /// Move constructor, sp is left empty
+        strong_ptr(strong_ptr &&sp) noexcept
+            :
+            _ptr{ sp._ptr },
+            _header{ sp._header }
+        {
+            sp._ptr = nullptr;
+            sp._header = nullptr;
+        }
+
+        /// Converting move constructor, for U * convertible to T *
+        template<typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+        strong_ptr(strong_ptr<U> &&sp) noexcept
+            :
+            _ptr{ sp._ptr },
+            _header{ sp._header }
+        {
+            sp._ptr = nullptr;
+            sp._header = nullptr;
+        }
+
+        /// Aliasing constructor: stores p and shares ownership with sp
+        template<typename U>
+        strong_ptr(const strong_ptr<U> &sp, T *p) noexcept
+            :
+            _ptr{ p },
+            _header{ sp._header }
+        {
+            _inc();
+        }
+
+        // Destructor
+
+        ~strong_ptr()
+        {
+            _dec();
+        }
+
+        // Assignment
+
+        strong_ptr &
+        operator=(const strong_ptr &sp) noexcept
+        {
+            strong_ptr{ sp }.swap(*this);
+            return *this;
+        }
+
+        strong_ptr &
+        operator=(strong_ptr &&sp) noexcept
+        {
+            strong_ptr{ std::move(sp) }.swap(*this);
+            return *this;
+        }
+
+        strong_ptr &
+        operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+
+        // Modifiers
+
+        void
+        reset() noexcept
+        {
+            strong_ptr{}.swap(*this);
+        }
+
+        void
+        swap(strong_ptr &sp) noexcept
+        {
+            std::swap(_ptr, sp._ptr);
+            std::swap(_header, sp._header);
+        }
+
+        // Observers
+
+        T *
+        get() const noexcept
+        {
+            return _ptr;
+        }
+
+        T &
+        operator*() const noexcept
+        {
+            assert(_ptr != nullptr);
+            return *_ptr;
+        }
+
+        T *
+        operator->() const noexcept
+        {
+            assert(_ptr != nullptr);
+            return _ptr;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return _ptr != nullptr;
+        }
+
+        /// Number of strong_ptrs sharing the object, 0 if empty
+        long
+        use_count() const noexcept
+        {
+            return _header ? _header->count.load(std::memory_order_relaxed) : 0;
+        }
+
+        /// Checks whether *this is the only owner, with acquire semantics
+        ///     as shared_ptr's control blocks
+        bool
+        unique() const noexcept
+        {
+            return _header && _header->count.load(std::memory_order_acquire) == 1;
+        }
+
+        /// Owner-based ordering
+        template<typename U>
+        bool
+        owner_before(const strong_ptr<U> &sp) const noexcept
+        {
+            return _header < sp._header;
+        }
+
+    private:
+        template<typename U>
+        friend class strong_ptr;
+
+        template<typename U, typename... Args>
+        friend strong_ptr<U> make_strong(Args &&...args);
+
+        template<typename U>
+        friend strong_ptr<U> to_strong_ptr(shared_ptr<U> sp);
+
+        /// Adopts the reference of a freshly allocated header
+        strong_ptr(T *p, detail::strong_header *h) noexcept
+            :
+            _ptr{ p },
+            _header{ h }
+        {
+        }
+
+        void
+        _inc() const noexcept
+        {
+            if (_header)
+                _header->count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void
+        _dec() noexcept
+        {
+            if (_header && _header->count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                _header->destroy(_header);
+        }
+
+        T *_ptr = nullptr;
+        detail::strong_header *_header = nullptr;
+    };
+
+    // Creation and conversions
+
+    /// Creates a strong_ptr that manages a new object, allocated with its
+    ///     header in a single allocation
+    template<typename T, typename... Args>
+    inline strong_ptr<T>
+    make_strong(Args &&...args)
+    {
+        auto *b = new detail::strong_block<T>{ std::forward<Args>(args)... };
+        return strong_ptr<T>{ b->ptr(), &b->header };
+    }
+
+    /// Shares the object of sp with shared_ptr code: allocates a shared_ptr
+    ///     control block whose deleter holds a reference of sp
+    template<typename T>
+    inline shared_ptr<T>
+    to_shared_ptr(strong_ptr<T> sp)
+    {
+        if (!sp)
+            return shared_ptr<T>{};
+        T *p = sp.get();
+        return shared_ptr<T>{ p, detail::strong_ptr_owner<T>{ std::move(sp) } };
+    }
+
+    /// Shares the object of sp with strong_ptr code: allocates a header
+    ///     that holds a reference of sp
+    template<typename T>
+    inline strong_ptr<T>
+    to_strong_ptr(shared_ptr<T> sp)
+    {
+        if (!sp)
+            return strong_ptr<T>{};
+        T *p = sp.get();
+        auto *b = new detail::strong_from_shared_block<T>{ std::move(sp) };
+        return strong_ptr<T>{ p, &b->header };
+    }
+
+    // Comparisons
+
+    template<typename T, typename U>
+    inline bool
+    operator==(const strong_ptr<T> &a, const strong_ptr<U> &b) noexcept
+    {
+        return a.get() == b.get();
+    }
+
+    template<typename T, typename U>
+    inline bool
+    operator!=(const strong_ptr<T> &a, const strong_ptr<U> &b) noexcept
+    {
+        return a.get() != b.get();
+    }
+
+    template<typename T>
+    inline bool
+    operator==(const strong_ptr<T> &a, std::nullptr_t) noexcept
+    {
+        return !a;
+    }
+
+    template<typename T>
+    inline bool
+    operator==(std::nullptr_t, const strong_ptr<T> &a) noexcept
+    {
+        return !a;
+    }
+
+    template<typename T>
+    inline bool
+    operator!=(const strong_ptr<T> &a, std::nullptr_t) noexcept
+    {
+        return static_cast<bool>(a);
+    }
+
+    template<typename T>
+    inline bool
+    operator!=(std::nullptr_t, const strong_ptr<T> &a) noexcept
+    {
+        return static_cast<bool>(a);
+    }
+
+    template<typename T>
+    inline void
+    swap(strong_ptr<T> &a, strong_ptr<T> &b) noexcept
+    {
+        a.swap(b);
+    }
+
+} // namespace smart_ptr
+
+namespace std
+{
+
+    template<typename T>
+    struct hash<smart_ptr::strong_ptr<T>>
+    {
+        using result_type = std::size_t;
+        using argument_type = smart_ptr::strong_ptr<T>;
+
+        std::size_t
+        operator()(const smart_ptr::strong_ptr<T> &sp) const noexcept
+        {
+            return hash<T *>()(sp.get());
+        }
+    };
+
+} // namespace std
+
+#endif
@@ -0,0 +1,163 @@
+// sweep_expired implementation
+
+/**
+ * A weak_ptr keeps its control block allocated until the weak_ptr itself
+ *  is destroyed, so a long-lived collection of weak_ptrs (observer lists,
+ *  registries) holds on to the control block of every object that has
+ *  died since it was added. sweep_expired() removes those entries
+ *  incrementally: each call examines at most budget elements from a
+ *  cursor kept by the caller and resumes where the previous call stopped,
+ *  so the cost of a sweep can be spread over many frames or requests.
+ *
+ * The elements may be weak_ptrs or pairs whose second member is a
+ *  weak_ptr, as in the value_type of a map to weak_ptrs.
+ *
+ * Checking expired() means touching a control block that is usually cold,
+ *  so the scans prefetch the control blocks a few elements ahead.
+ */
+
+#ifndef SWEEP_EXPIRED_HPP
+#define SWEEP_EXPIRED_HPP 1
+
+#include <cstddef> // size_t
+#include <utility> // pair, move
+
+#include "shared_ptr.hpp"
+#include "weak_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    namespace detail
+    {
+
+        // how many elements ahead of the scan control blocks are prefetched
+        constexpr std::size_t sweep_prefetch_distance = 8;
+
+        template<typename T>
+        inline const weak_ptr<T> &
+        swept_weak(const weak_ptr<T> &wp) noexcept
+        {
+            return wp;
+        }
+
+        template<typename K, typename T>
+        inline const weak_ptr<T> &
+        swept_weak(const std::pair<K, weak_ptr<T>> &kv) noexcept
+        {
+            return kv.second;
+        }
+
+        template<typename T>
+        inline void
+        prefetch_control_block(const weak_ptr<T> &wp) noexcept
+        {
+#if defined(__GNUC__)
+            __builtin_prefetch(shared_ptr_internals::control_block(wp));
+#else
+            (void)wp;
+#endif
+        }
+
+    } // namespace detail
+
+    /// Writes whether each weak_ptr in [first, last) has expired to out,
+    ///     prefetching the control blocks ahead of the scan
+    /// Elements are weak_ptrs or pairs whose second member is a weak_ptr.
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt
+    expired_batch(ForwardIt first, ForwardIt last, OutputIt out)
+    {
+        ForwardIt ahead = first;
+        for (std::size_t i = 0; i < detail::sweep_prefetch_distance && ahead != last; ++i, ++ahead)
+            detail::prefetch_control_block(detail::swept_weak(*ahead));
+        for (; first != last; ++first, ++out)
+        {
+            if (ahead != last)
+            {
+                detail::prefetch_control_block(detail::swept_weak(*ahead));
+                ++ahead;
+            }
+            *out = detail::swept_weak(*first).expired();
+        }
+        return out;
+    }
+
+    /// Removes expired weak_ptrs from a random-access sequence container
+    ///     (vector, deque), examining at most budget elements from cursor
+    /// An expired element is replaced by the last one, so the order of the
+    ///     elements is not preserved. cursor wraps to 0 once the end is
+    ///     reached, a caller that starts at 0 and keeps calling with the same
+    ///     cursor visits every element.
+    /// Returns the number of elements removed.
+    template<typename Container>
+    std::size_t
+    sweep_expired(Container &c, std::size_t budget, std::size_t &cursor)
+    {
+        std::size_t removed = 0;
+        if (cursor >= c.size())
+            cursor = 0;
+        for (; budget && cursor < c.size(); --budget)
+        {
+            std::size_t ahead = cursor + detail::sweep_prefetch_distance;
+            if (ahead < c.size())
+                detail::prefetch_control_block(detail::swept_weak(c[ahead]));
+            if (detail::swept_weak(c[cursor]).expired())
+            {
+                if (c.size() > 1) // the back refills this slot
+                    detail::prefetch_control_block(detail::swept_weak(c[c.size() - 2]));
+                if (cursor + 1 != c.size())
+                    c[cursor] = std::move(c.back()); // examined on the next iteration
+                c.pop_back();
+                ++removed;
+            }
+            else
+            {
+                ++cursor;
+            }
+        }
+        if (cursor >= c.size())
+            cursor = 0;
+        return removed;
+    }
+
+    /// Removes expired weak_ptrs from a node-based container (list, set,
+    ///     map, unordered_map), examining at most budget elements from cursor
+    /// cursor wraps to c.begin() once the end is reached. Iterators to the
+    ///     elements that are kept stay valid.
+    /// Returns the number of elements removed.
+    template<typename Container>
+    std::size_t
+    sweep_expired(Container &c, std::size_t budget, typename Container::iterator &cursor)
+    {
+        std::size_t removed = 0;
+        if (cursor == c.end())
+            cursor = c.begin();
+        auto ahead = cursor;
+        for (std::size_t i = 0; i < detail::sweep_prefetch_distance && ahead != c.end(); ++i, ++ahead)
+            detail::prefetch_control_block(detail::swept_weak(*ahead));
+        for (; budget && cursor != c.end(); --budget)
+        {
+            if (ahead != c.end())
+            {
+                detail::prefetch_control_block(detail::swept_weak(*ahead));
+                ++ahead;
+            }
+            if (detail::swept_weak(*cursor).expired())
+            {
+                cursor = c.erase(cursor);
+                ++removed;
+            }
+            else
+            {
+                ++cursor;
+            }
+        }
+        if (cursor == c.end())
+            cursor = c.begin();
+        return removed;
+    }
+
+} // namespace smart_ptr
+
+#endif
@@ -4,6 +4,7 @@
 #define UNIQUE_PTR_HPP 1
 
 #include <cstddef> /// size_t, nullptr_t
+#include <new> /// placement new, bad_array_new_length
 #include <cassert> /// assert
 #include <utility> /// move, forward, swap
 #include <functional> /// less, hash
@@ -21,7 +22,7 @@ namespace smart_ptr
     class unique_ptr
     {
     public:
-        using pointer = T *;
+        using pointer = typename detail::Ptr<T, D>::pointer; // D::pointer if present, T * otherwise
         using element_type = T;
         using deleter_type = D;
 
@@ -86,7 +87,7 @@ namespace smart_ptr
         {
             auto _ptr = _impl._impl_ptr();
             auto &_deleter = _impl._impl_deleter();
-            if (_ptr)
+            if (_ptr != nullptr)
                 _deleter(_ptr);
         }
 
@@ -122,7 +123,7 @@ namespace smart_ptr
         // 20.7.1.2.4, observers
 
         /// Dereferences pointer to the managed object
-        element_type &
+        SMART_PTR_FORCE_INLINE element_type &
         operator*() const noexcept
         {
             auto _ptr = _impl._impl_ptr();
@@ -131,7 +132,7 @@ namespace smart_ptr
         }
 
         /// Dereferences pointer to the managed object
-        pointer
+        SMART_PTR_FORCE_INLINE pointer
         operator->() const noexcept
         {
             auto _ptr = _impl._impl_ptr();
@@ -140,7 +141,7 @@ namespace smart_ptr
         }
 
         /// Gets the stored pointer
-        pointer
+        SMART_PTR_FORCE_INLINE pointer
         get() const noexcept
         {
             return _impl._impl_ptr();
@@ -161,20 +162,20 @@ namespace smart_ptr
         }
 
         /// Checks if there is an associated managed object
-        explicit operator bool() const noexcept
+        SMART_PTR_FORCE_INLINE explicit operator bool() const noexcept
         {
-            return (_impl._impl_ptr()) ? true : false;
+            return _impl._impl_ptr() != nullptr;
         }
 
         // 20.7.1.2.5 modifiers
 
-        /// Releases ownership to the returned raw pointer
+        /// Releases ownership to the returned pointer
         pointer
         release() noexcept
         {
             auto &_ptr = _impl._impl_ptr();
             pointer cp = _ptr;
-            _ptr = nullptr;
+            _ptr = pointer();
             return cp;
         }
 
@@ -184,7 +185,7 @@ namespace smart_ptr
         {
             auto &_ptr = _impl._impl_ptr();
             auto &_deleter = _impl._impl_deleter();
-            if (_ptr)
+            if (_ptr != nullptr)
                 _deleter(_ptr);
             _ptr = p;
         }
@@ -195,9 +196,9 @@ namespace smart_ptr
         {
             auto &_ptr = _impl._impl_ptr();
             auto &_deleter = _impl._impl_deleter();
-            if (_ptr)
+            if (_ptr != nullptr)
                 _deleter(_ptr);
-            _ptr = pointer{}; /// probably nullptr
+            _ptr = pointer();
         }
 
         /// Swaps with another unique_ptr
@@ -226,7 +227,7 @@ namespace smart_ptr
     class unique_ptr<T[], D>
     {
     public:
-        using pointer = T *;
+        using pointer = typename detail::Ptr<T, D>::pointer; // D::pointer if present, T * otherwise
         using element_type = T;
         using deleter_type = D;
 
@@ -283,7 +284,7 @@ namespace smart_ptr
         {
             auto _ptr = _impl._impl_ptr();
             auto &_deleter = _impl._impl_deleter();
-            if (_ptr)
+            if (_ptr != nullptr)
                 _deleter(_ptr);
         }
 
@@ -310,7 +311,7 @@ namespace smart_ptr
 
         /// Index operator, dereferencing operators are not provided,
         /// bound range is not checked
-        element_type &
+        SMART_PTR_FORCE_INLINE element_type &
         operator[](std::size_t i) const noexcept
         {
             auto _ptr = _impl._impl_ptr();
@@ -319,7 +320,7 @@ namespace smart_ptr
         }
 
         /// Gets the stored pointer
-        pointer
+        SMART_PTR_FORCE_INLINE pointer
         get() const noexcept
         {
             return _impl._impl_ptr();
@@ -340,20 +341,20 @@ namespace smart_ptr
         }
 
         /// Checks if there is an associated managed object
-        explicit operator bool() const noexcept
+        SMART_PTR_FORCE_INLINE explicit operator bool() const noexcept
         {
-            return (_impl._impl_ptr()) ? true : false;
+            return _impl._impl_ptr() != nullptr;
         }
 
         // 20.7.1.3.3 modifiers
 
-        /// Releases ownership to the returned raw pointer
+        /// Releases ownership to the returned pointer
         pointer
         release() noexcept
         {
             auto &_ptr = _impl._impl_ptr();
             pointer cp = _ptr;
-            _ptr = nullptr;
+            _ptr = pointer();
             return cp;
         }
 
@@ -363,7 +364,7 @@ namespace smart_ptr
         {
             auto &_ptr = _impl._impl_ptr();
             auto &_deleter = _impl._impl_deleter();
-            if (_ptr)
+            if (_ptr != nullptr)
                 _deleter(_ptr);
             _ptr = p;
         }
@@ -374,9 +375,9 @@ namespace smart_ptr
         {
             auto &_ptr = _impl._impl_ptr();
             auto &_deleter = _impl._impl_deleter();
-            if (_ptr)
+            if (_ptr != nullptr)
                 _deleter(_ptr);
-            _ptr = pointer{}; /// probably nullptr
+            _ptr = pointer();
         }
 
         /// Swaps with another unique_ptr
@@ -421,10 +422,14 @@ namespace smart_ptr
     };
 
     /// Only for non-array types
+    /// Before C++17 an over-aligned T needs its own operator new, or
+    ///     make_shared or make_unique_aligned, which align it.
     template<typename T, typename... Args>
     typename _Unique_if<T>::_Single_object
     make_unique(Args &&...args)
     {
+        static_assert(detail::is_new_aligned<T>::value,
+            "new T cannot align an over-aligned T before C++17, use make_unique_aligned");
         return unique_ptr<T>{ new T{ std::forward<Args>(args)... } };
     }
 
@@ -433,6 +438,8 @@ namespace smart_ptr
     typename _Unique_if<T>::_Unknown_bound
     make_unique(std::size_t n)
     {
+        static_assert(detail::is_new_aligned<T>::value,
+            "new T[n] cannot align an over-aligned T before C++17, use make_unique_aligned");
         using U = typename std::remove_extent<T>::type;
         return unique_ptr<T>{ new U[n]{} };
     }
@@ -442,6 +449,86 @@ namespace smart_ptr
     typename _Unique_if<T>::_Known_bound
     make_unique(Args &&...) = delete;
 
+    /* added in C++20 */
+    // make_unique_for_overwrite: as make_unique, but default-initializes,
+    // so trivial types and arrays of them are left uninitialized
+
+    /// Only for non-array types
+    template<typename T>
+    typename _Unique_if<T>::_Single_object
+    make_unique_for_overwrite()
+    {
+        static_assert(detail::is_new_aligned<T>::value,
+            "new T cannot align an over-aligned T before C++17, use make_unique_aligned");
+        return unique_ptr<T>{ new T };
+    }
+
+    /// Only for array types with unknown bound
+    template<typename T>
+    typename _Unique_if<T>::_Unknown_bound
+    make_unique_for_overwrite(std::size_t n)
+    {
+        static_assert(detail::is_new_aligned<T>::value,
+            "new T[n] cannot align an over-aligned T before C++17, use make_unique_aligned");
+        using U = typename std::remove_extent<T>::type;
+        return unique_ptr<T>{ new U[n] };
+    }
+
+    /// Only for array types with known bound: unspecified
+    template<typename T, typename... Args>
+    typename _Unique_if<T>::_Known_bound
+    make_unique_for_overwrite(Args &&...) = delete;
+
+    // make_unique_aligned: as make_unique<T[]>(n), with the elements
+    // starting on an alignment boundary chosen at runtime
+
+    template<typename T>
+    struct _Unique_aligned_if
+    {
+    };
+
+    template<typename T>
+    struct _Unique_aligned_if<T[]>
+    {
+        using _Unknown_bound = unique_ptr<T[], aligned_delete<T[]>>;
+    };
+
+    /// Only for array types with unknown bound, value-initializes n elements
+    ///     aligned to align, a power of two, at least alignof(T)
+    /// Throws std::invalid_argument if align is not a power of two.
+    template<typename T>
+    typename _Unique_aligned_if<T>::_Unknown_bound
+    make_unique_aligned(std::size_t n, std::size_t align)
+    {
+        detail::check_alignment(align);
+        using U = typename std::remove_extent<T>::type;
+        if (align < alignof(U))
+            align = alignof(U);
+        if (align < alignof(detail::aligned_array_header))
+            align = alignof(detail::aligned_array_header);
+        std::size_t offset = detail::aligned_array_offset(align);
+        if (n > (std::size_t(-1) - offset) / sizeof(U))
+            throw std::bad_array_new_length{};
+        char *mem = static_cast<char *>(detail::allocate_aligned(offset + n * sizeof(U), align));
+        U *first = reinterpret_cast<U *>(mem + offset);
+        std::size_t i = 0;
+        try
+        {
+            for (; i < n; ++i)
+                ::new (static_cast<void *>(first + i)) U();
+        }
+        catch (...)
+        {
+            while (i)
+                first[--i].~U();
+            detail::deallocate_aligned(mem, offset + n * sizeof(U), align);
+            throw;
+        }
+        ::new (static_cast<void *>(mem + offset - sizeof(detail::aligned_array_header)))
+            detail::aligned_array_header{ n, align };
+        return typename _Unique_aligned_if<T>::_Unknown_bound{ first };
+    }
+
     // 20.7.1.4 unique_ptr specialized algorithms
 
     /// Operator == overloading
@@ -606,26 +693,26 @@ namespace std
 
     // 20.7.2.6 Smart pointer hash support
 
-    // Template specialization of std::hash for smart_ptr::unique_ptr<T>
+    // Template specialization of std::hash for smart_ptr::unique_ptr<T, D>
 
     /**
  * Allows users to obtain hashes of objects of type smart_ptr::unique_ptr<T>,
  *  which can be used to store those objects in an unordered container.
  * 
- * This specialization ensures that std::hash<smart_ptr::unique_ptr<T>>()(up) ==
- *  hash<typename smart_ptr::unique_ptr<T>::element_type*>()(up.get()).
+ * This specialization ensures that std::hash<smart_ptr::unique_ptr<T, D>>()(up) ==
+ *  hash<typename smart_ptr::unique_ptr<T, D>::pointer>()(up.get()).
  */
 
-    template<typename T>
-    struct hash<smart_ptr::unique_ptr<T>>
+    template<typename T, typename D>
+    struct hash<smart_ptr::unique_ptr<T, D>>
     {
         using result_type = std::size_t;
-        using argument_type = smart_ptr::unique_ptr<T>;
+        using argument_type = smart_ptr::unique_ptr<T, D>;
 
         std::size_t
-        operator()(const smart_ptr::unique_ptr<T> &up) const
+        operator()(const smart_ptr::unique_ptr<T, D> &up) const
         {
-            return hash<typename smart_ptr::unique_ptr<T>::element_type *>()(up.get());
+            return hash<typename smart_ptr::unique_ptr<T, D>::pointer>()(up.get());
         }
     };
 
@@ -4,6 +4,7 @@
 #define WEAK_PTR_HPP 1
 
 #include <type_traits> // remove_extent
+#include <utility> // move
 
 #include "control_block.hpp"
 #include "shared_ptr.hpp"
@@ -16,6 +17,11 @@ namespace smart_ptr
     template<typename T>
     class shared_ptr;
 
+    namespace detail
+    {
+        struct shared_ptr_internals;
+    } // namespace detail
+
     // 20.7.2.3 Class template weak_ptr
 
     template<typename T>
@@ -28,6 +34,8 @@ namespace smart_ptr
         template<typename U>
         friend class weak_ptr;
 
+        friend struct detail::shared_ptr_internals;
+
         using element_type = typename std::remove_extent<T>::type;
 
         // 20.7.2.3.1, constructors:
@@ -76,6 +84,18 @@ namespace smart_ptr
                 _control_block->inc_wref();
         }
 
+        /// Move constructor: takes over the weak reference of wp
+        /// Postconditions: *this shall contain the old value of wp.
+        ///     wp shall be empty.
+        weak_ptr(weak_ptr &&wp) noexcept
+            :
+            _ptr{ wp._ptr },
+            _control_block{ wp._control_block }
+        {
+            wp._ptr = nullptr;
+            wp._control_block = nullptr;
+        }
+
         // 20.7.2.3.2, destructor
 
         ~weak_ptr()
@@ -93,6 +113,13 @@ namespace smart_ptr
             return *this;
         }
 
+        weak_ptr &
+        operator=(weak_ptr &&wp) noexcept
+        {
+            weak_ptr{ std::move(wp) }.swap(*this);
+            return *this;
+        }
+
         template<typename U>
         weak_ptr &
         operator=(const weak_ptr<U> &wp) noexcept
@@ -136,18 +163,22 @@ namespace smart_ptr
             return (_control_block) ? _control_block->use_count() : 0;
         }
 
-        /// Checks if use_count == 0
+        /// Checks if use_count == 0, an empty weak_ptr is expired
         bool
         expired() const noexcept
         {
-            return (_control_block) ? _control_block->expired() : false;
+            return (_control_block) ? _control_block->expired() : true;
         }
 
-        /// Checks if there is a managed object
+        /// Creates a shared_ptr that shares ownership of the managed object,
+        ///     or an empty one if it has expired. Atomic with respect to
+        ///     the release of the last shared_ptr.
         shared_ptr<T>
         lock() const noexcept
         {
-            return (expired()) ? shared_ptr<T>{} : shared_ptr<T>{ *this };
+            if (_control_block && _control_block->try_inc_ref())
+                return shared_ptr<T>{ _ptr, _control_block, detail::adopt_control_block_t{} };
+            return shared_ptr<T>{};
         }
 
         /// Checks whether this shared_ptr precedes other in owner-based order
@@ -166,6 +197,29 @@ namespace smart_ptr
             return std::less<detail::control_block_base *>()(_control_block, wp._control_block);
         }
 
+        /// Hash of the owner, consistent with owner_equal
+        /// Implemented by mixing the address of control_block
+        std::size_t owner_hash() const noexcept
+        {
+            return detail::owner_hash_of(_control_block);
+        }
+
+        /// Checks whether this weak_ptr and other share ownership or are both empty
+        /// Implemented by comparing the address of control_block
+        template<typename U>
+        bool owner_equal(shared_ptr<U> const &sp) const noexcept
+        {
+            return _control_block == sp._control_block;
+        }
+
+        /// Checks whether this weak_ptr and other share ownership or are both empty
+        /// Implemented by comparing the address of control_block
+        template<class U>
+        bool owner_equal(weak_ptr<U> const &wp) const noexcept
+        {
+            return _control_block == wp._control_block;
+        }
+
     private:
         element_type *_ptr;
         detail::control_block_base *_control_block;
@@ -0,0 +1,265 @@
+// weak_value_map implementation
+
+/**
+ * weak_value_map<K, T> interns shared objects by key without keeping them
+ *  alive: it stores weak_ptr<T>s, so an entry disappears once nobody holds
+ *  the object any more.
+ *
+ * get_or_create(key, factory) returns the live object for key, or calls
+ *  factory() to build one. Concurrent callers asking for the same missing
+ *  key do not race to construct duplicates: the first one runs the
+ *  factory outside the lock, the others wait for its result.
+ *
+ * The map is split into independently locked shards. Expired entries are
+ *  purged lazily, a shard is swept whenever it has doubled in size since
+ *  its last sweep, which keeps the purging cost amortized O(1) per insert.
+ */
+
+#ifndef WEAK_VALUE_MAP_HPP
+#define WEAK_VALUE_MAP_HPP 1
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <mutex> // mutex, unique_lock, lock_guard
+#include <condition_variable> // condition_variable
+#include <exception> // exception_ptr, current_exception, rethrow_exception
+#include <functional> // hash, equal_to
+#include <unordered_map> // unordered_map
+#include <utility> // forward
+
+#include "shared_ptr.hpp"
+#include "weak_ptr.hpp"
+
+namespace smart_ptr
+{
+
+    template<typename K, typename T,
+        typename Hash = std::hash<K>,
+        typename KeyEqual = std::equal_to<K>>
+    class weak_value_map
+    {
+    public:
+        using key_type = K;
+        using mapped_type = T;
+
+        /// Creates an empty map with at least the given number of shards
+        explicit weak_value_map(std::size_t shards = 16) :
+            _shard_bits{ 0 }
+        {
+            while ((std::size_t{ 1 } << _shard_bits) < shards && _shard_bits < 16)
+                ++_shard_bits;
+            _shards = new shard[std::size_t{ 1 } << _shard_bits];
+        }
+
+        ~weak_value_map()
+        {
+            delete[] _shards;
+        }
+
+        weak_value_map(const weak_value_map &) = delete;
+        weak_value_map &operator=(const weak_value_map &) = delete;
+
+        /// Returns the live object for key, or the one built by factory()
+        /// factory: callable returning shared_ptr<T>, run at most once per
+        ///     missing key however many threads ask for it concurrently.
+        ///     If it throws, every waiting caller gets the exception.
+        template<typename Factory>
+        shared_ptr<T>
+        get_or_create(const K &key, Factory &&factory)
+        {
+            shard &s = _shard_for(key);
+            std::unique_lock<std::mutex> lock{ s.mutex };
+
+            auto it = s.map.find(key);
+            if (it != s.map.end())
+            {
+                if (shared_ptr<T> sp = it->second.value.lock())
+                    return sp;
+                if (shared_ptr<pending> p = it->second.in_flight)
+                {
+                    lock.unlock();
+                    return _wait(*p);
+                }
+            }
+            else
+            {
+                if (s.map.size() >= s.purge_at)
+                    _purge(s);
+                it = s.map.emplace(key, entry{}).first;
+            }
+
+            shared_ptr<pending> p = make_shared<pending>();
+            it->second.in_flight = p;
+            lock.unlock();
+
+            shared_ptr<T> value;
+            try
+            {
+                value = factory();
+            }
+            catch (...)
+            {
+                _settle(s, key, p, shared_ptr<T>{}, std::current_exception());
+                throw;
+            }
+            _settle(s, key, p, value, std::exception_ptr{});
+            return value;
+        }
+
+        /// Returns the live object for key, or an empty shared_ptr
+        shared_ptr<T>
+        find(const K &key) const
+        {
+            shard &s = _shard_for(key);
+            std::lock_guard<std::mutex> lock{ s.mutex };
+            auto it = s.map.find(key);
+            return (it != s.map.end()) ? it->second.value.lock() : shared_ptr<T>{};
+        }
+
+        /// Forgets key, the object itself stays alive while referenced
+        bool
+        erase(const K &key)
+        {
+            shard &s = _shard_for(key);
+            std::lock_guard<std::mutex> lock{ s.mutex };
+            auto it = s.map.find(key);
+            if (it == s.map.end() || it->second.in_flight)
+                return false;
+            s.map.erase(it);
+            return true;
+        }
+
+        /// Removes every expired entry now, returns how many were removed
+        std::size_t
+        purge()
+        {
+            std::size_t removed = 0;
+            for (std::size_t i = 0; i < _shard_count(); ++i)
+            {
+                std::lock_guard<std::mutex> lock{ _shards[i].mutex };
+                removed += _purge(_shards[i]);
+            }
+            return removed;
+        }
+
+        /// Number of entries, including expired ones not purged yet
+        std::size_t
+        size() const
+        {
+            std::size_t n = 0;
+            for (std::size_t i = 0; i < _shard_count(); ++i)
+            {
+                std::lock_guard<std::mutex> lock{ _shards[i].mutex };
+                n += _shards[i].map.size();
+            }
+            return n;
+        }
+
+    private:
+        // result of a construction in progress, shared with the waiters
+
+        struct pending
+        {
+            std::mutex mutex;
+            std::condition_variable ready;
+            bool done = false;
+            shared_ptr<T> value;
+            std::exception_ptr error;
+        };
+
+        struct entry
+        {
+            weak_ptr<T> value;
+            shared_ptr<pending> in_flight; // set while a factory runs for this key
+        };
+
+        struct shard
+        {
+            std::mutex mutex;
+            std::unordered_map<K, entry, Hash, KeyEqual> map;
+            std::size_t purge_at = 64;
+            char pad[64]; // keeps neighbouring shard locks off one cache line
+        };
+
+        std::size_t
+        _shard_count() const noexcept
+        {
+            return std::size_t{ 1 } << _shard_bits;
+        }
+
+        shard &
+        _shard_for(const K &key) const
+        {
+            // the buckets of the shard maps use the low bits of the same
+            // hash, so pick the shard from the high bits of a mixed hash
+            std::uint64_t h = static_cast<std::uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ull;
+            return _shards[_shard_bits ? (h >> (64 - _shard_bits)) : 0];
+        }
+
+        // Publishes the outcome of a factory call to the map and the waiters
+        void
+        _settle(shard &s, const K &key, const shared_ptr<pending> &p,
+            const shared_ptr<T> &value, std::exception_ptr error)
+        {
+            {
+                std::lock_guard<std::mutex> lock{ s.mutex };
+                auto it = s.map.find(key);
+                if (it != s.map.end() && it->second.in_flight == p)
+                {
+                    if (error)
+                        s.map.erase(it);
+                    else
+                    {
+                        it->second.value = value;
+                        it->second.in_flight.reset();
+                    }
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock{ p->mutex };
+                p->done = true;
+                p->value = value;
+                p->error = error;
+            }
+            p->ready.notify_all();
+        }
+
+        static shared_ptr<T>
+        _wait(pending &p)
+        {
+            std::unique_lock<std::mutex> lock{ p.mutex };
+            while (!p.done)
+                p.ready.wait(lock);
+            if (p.error)
+                std::rethrow_exception(p.error);
+            return p.value;
+        }
+
+        // Erases the expired entries of s, the caller holds s.mutex
+        static std::size_t
+        _purge(shard &s)
+        {
+            std::size_t removed = 0;
+            for (auto it = s.map.begin(); it != s.map.end();)
+            {
+                if (!it->second.in_flight && it->second.value.expired())
+                {
+                    it = s.map.erase(it);
+                    ++removed;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            s.purge_at = (s.map.size() < 32) ? 64 : 2 * s.map.size();
+            return removed;
+        }
+
+        unsigned _shard_bits;
+        shard *_shards;
+    };
+
+} // namespace smart_ptr
+
+#endif
@@ -0,0 +1,119 @@
+// demo of offset_shared_ptr and offset_unique_ptr across processes
+
+/**
+ *  Builds a linked list of offset_shared_ptr nodes in a memfd segment,
+ *  then forks a worker that maps the same memfd a second time, at another
+ *  address, and walks, extends and releases the list through that
+ *  mapping. Linux only (memfd_create).
+ */
+
+#include <iostream>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <utility>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "include/offset_ptr.hpp"
+using smart_ptr::segment;
+using smart_ptr::offset_shared_ptr;
+using smart_ptr::offset_unique_ptr;
+using smart_ptr::make_offset_shared;
+using smart_ptr::make_offset_unique;
+
+struct node
+{
+    long value;
+    offset_shared_ptr<node> next; // relative, valid in every mapping
+    node(long value, offset_shared_ptr<node> next) : value{value}, next{std::move(next)} {}
+};
+
+struct stats
+{
+    std::atomic<long> visits{0};
+};
+
+const std::size_t segment_size = 1 << 20;
+
+void* map(int fd)
+{
+    void* p = ::mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    assert(p != MAP_FAILED);
+    return p;
+}
+
+long sum(const offset_shared_ptr<node>& head)
+{
+    long s = 0;
+    for (const node* n = head.get(); n; n = n->next.get())
+        s += n->value;
+    return s;
+}
+
+int main()
+{
+    std::cout << "===============offset_ptr demo===============" << std::endl;
+    int fd = ::memfd_create("offset_ptr_demo", 0);
+    assert(fd >= 0);
+    int rc = ::ftruncate(fd, segment_size);
+    assert(rc == 0);
+    (void)rc;
+
+    void* base = map(fd);
+    segment seg = segment::create(base, segment_size);
+
+    std::cout << "\nBuilding a list in the segment\n";
+    {
+        offset_shared_ptr<node> head;
+        for (long i = 1; i <= 10; ++i)
+            head = make_offset_shared<node>(seg, i, std::move(head));
+        seg.set_root(head);
+        std::cout << "sum " << sum(head) << ", head use_count " << head.use_count() << std::endl; // 55, 2
+    } // the segment root keeps the list alive
+    auto st = make_offset_unique<stats>(seg);
+
+    std::cout << "\nWorker process, through a second mapping\n";
+    std::size_t stats_offset = reinterpret_cast<char*>(st.get()) - static_cast<char*>(base);
+    std::cout << std::flush; // or the child prints the buffered output again
+    pid_t pid = ::fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        {
+            void* other = map(fd); // a different address than base
+            segment view = segment::attach(other);
+            auto head = view.root<node>();
+            std::cout << "mapped elsewhere: " << (other != base) << ", sum " << sum(head) << std::endl; // 1, 55
+            head = make_offset_shared<node>(view, 100L, std::move(head)); // allocate from the worker
+            view.set_root(head);
+            auto* s = reinterpret_cast<stats*>(static_cast<char*>(other) + stats_offset);
+            for (const node* n = head.get(); n; n = n->next.get())
+                s->visits.fetch_add(1);
+        } // the worker's reference to the list is released here
+        std::_Exit(0); // skips ~st, the stats belong to the parent
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::cout << "\nBack in the parent\n";
+    {
+        auto head = seg.root<node>();
+        std::cout << "sum " << sum(head) << ", visits " << st->visits
+                  << ", head use_count " << head.use_count() << std::endl; // 155, 11, 2
+        std::cout << "sizeof(offset_shared_ptr<node>) " << sizeof(head) << std::endl; // 8
+        std::size_t before = seg.unused();
+        seg.set_root(offset_shared_ptr<node>{}); // drop the segment's reference
+        head.reset(); // last owner, the nodes go back to the free lists
+        auto reused = make_offset_shared<node>(seg, 1L, offset_shared_ptr<node>{});
+        std::cout << "block reused: " << (seg.unused() == before) << std::endl; // 1
+    }
+
+    st.reset();
+    ::munmap(base, segment_size);
+    ::close(fd);
+    return 0;
+}
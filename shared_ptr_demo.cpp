@@ -190,15 +190,25 @@ int main()
         printf("%p %p\n", p0.get(), p1.get());
         printf("%d %d\n", p0 < p1, p1 < p0);  // 1 0
         printf("%d %d\n", p0.owner_before(p1), p1.owner_before(p0));  // 0 0
+        printf("%d %d\n", p0.owner_equal(p1), p0.owner_hash() == p1.owner_hash());  // 1 1
     }
 
     std::cout << "\nGet deleter demo\n";
     {
-        auto sp = make_shared<D>();
+        shared_ptr<D> sp(new D); // make_shared stores no deleter, get_deleter would return nullptr
         D* p = new D;
         auto del_p = get_deleter<default_delete<D>>(sp);
         (*del_p)(p);
     }
 
+    std::cout << "\nArray demo\n";
+    {
+        auto sp = make_shared<int[]>(4, 7); // count, counters and elements in one allocation
+        sp[1] = 1;
+        auto fixed = make_shared<double[3]>(); // value-initialized
+        shared_ptr<int[]> raw(new int[2]{ 5, 6 }); // deleted with delete[]
+        std::cout << sp[0] << ' ' << sp[1] << ' ' << fixed[2] << ' ' << raw[1] << std::endl;
+    }
+
     return 0;
 }
@@ -8,7 +8,24 @@
 #include "include/weak_ptr.hpp"
 
 #include "include/default_delete.hpp"
-#include "include/bad_weak_ptr.hpp"
 #include "include/owner_less.hpp"
+#include "include/owner_hash.hpp"
+
+#include "include/cycle_collector.hpp"
+#include "include/shared_pool.hpp"
+#include "include/arena.hpp"
+#include "include/weak_value_map.hpp"
+#include "include/owner_flat_map.hpp"
+#include "include/sweep_expired.hpp"
+#include "include/cow_ptr.hpp"
+#include "include/poly_value.hpp"
+#include "include/offset_ptr.hpp"
+#include "include/shared_buffer.hpp"
+#include "include/shared_bytes.hpp"
+#include "include/ptr_queue.hpp"
+#include "include/slot_map.hpp"
+#include "include/immortal.hpp"
+#include "include/lazy_weak.hpp"
+#include "include/strong_ptr.hpp"
 
 #endif
@@ -11,6 +11,9 @@
 #include <utility>
 #include <cstdio>
 #include <cassert>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
 
 // #include <memory>
 // using std::default_deleter;
@@ -24,6 +27,27 @@ using smart_ptr::make_unique;
 
 void close_file(std::FILE* fp) { std::fclose(fp); }
 
+// a file descriptor that can stand in for a pointer (NullablePointer)
+struct fd_handle
+{
+    int fd = -1;
+    fd_handle() = default;
+    fd_handle(std::nullptr_t) {}
+    explicit fd_handle(int fd) : fd{fd} {}
+    friend bool operator==(fd_handle a, fd_handle b) { return a.fd == b.fd; }
+    friend bool operator!=(fd_handle a, fd_handle b) { return a.fd != b.fd; }
+};
+
+struct fd_closer
+{
+    using pointer = fd_handle; // unique_ptr stores an fd_handle, not an int*
+    void operator()(fd_handle h) const
+    {
+        std::cout << "closing fd " << h.fd << std::endl;
+        ::close(h.fd);
+    }
+};
+
 struct B {
     B() = default;
     virtual ~B() = default;
@@ -81,6 +105,18 @@ int main()
         up->bar();
     } // the lambda above is called and D is destroyed
 
+    std::cout << "\nDeleter pointer type (D::pointer) demo\n";
+    std::ofstream("demo.txt") << 'x'; // prepare the file to read
+    {
+        unique_ptr<int, fd_closer> fd{fd_handle{::open("demo.txt", O_RDONLY)}};
+        char c = 0;
+        if (fd.get().fd >= 0 && ::read(fd.get().fd, &c, 1) == 1)
+            std::cout << c << std::endl;
+        std::cout << sizeof(fd) << std::endl; // 4, just the descriptor
+        unique_ptr<int, fd_closer> moved{std::move(fd)};
+        assert(!fd && moved);
+    } // close() called here, once
+
     std::cout << "\nArray form of unique_ptr demo\n";
     {
         unique_ptr<D[]> up{new D[3]};